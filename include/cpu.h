@@ -3,41 +3,174 @@
 #define CPU_H
 
 #include "ins.h"
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 
 #define MEM_MAX 65536   //(64 * 1024)
+#define PAGE_COUNT (MEM_MAX / 256)
+
+#if !defined(_WIN32) && !defined(__STDC_LIB_EXT1__)
+#define printf_s printf
+#endif
 
 typedef uint8_t byte;
 typedef uint16_t word;
 
+#define PAGE_SIZE 256
+
+typedef byte(*IoRead)(void* ctx, word addr);
+typedef void(*IoWrite)(void* ctx, word addr, byte val);
+
+struct DecodeCache;
+struct Jit;
+struct IoPage;
+struct SharedPage;
+struct Snapshot;
+struct TraceRing;
+struct Profile;
+struct Scheduler;
+
+//Memory bus. Every 256-byte page is either host memory, reached through
+//readPages/writePages, or an I/O page whose entries there are NULL. By
+//default all pages map to data. ROM pages write to a scratch page, so
+//writes to them need no extra check. Pages captured by a snapshot have no
+//write pointer until their first write.
 struct RAM {
    byte* data;
+   byte* readPages[PAGE_COUNT];
+   byte* writePages[PAGE_COUNT];
+   struct IoPage* io;           //NULL unless map_io() was called.
+   struct SharedPage* shared[PAGE_COUNT];   //Snapshot copy of a page not written since, else NULL.
+   bool flat;                   //Every page maps to data and is writable. The JIT needs this.
+   struct DecodeCache* cache;   //NULL unless init_decode_cache() was called.
+   struct Jit* jit;             //NULL unless init_jit() was called.
+   struct TraceRing* trace;     //NULL unless start_trace() was called.
+   struct Profile* profile;     //NULL unless init_profiler() was called.
+   struct Scheduler* sched;     //NULL unless init_scheduler() was called.
+   byte codePages[PAGE_COUNT / 8];   //Pages holding decoded or compiled code.
+   byte dirtyPages[PAGE_COUNT / 8];  //Pages written since clear_dirty_pages(). Needs CPU_DIRTY_PAGES.
+   byte romSink[PAGE_SIZE];     //Write target of ROM pages.
 };
 
-struct CPU {
-   word pc;
-   word sp;
+//Status flags, as bit masks in the packed PS byte.
+typedef enum {
+   FLAG_C = 0x01,
+   FLAG_Z = 0x02,
+   FLAG_I = 0x04,
+   FLAG_D = 0x08,
+   FLAG_B = 0x10,
+   FLAG_V = 0x40,
+   FLAG_N = 0x80
+} StatusFlag;
 
+//Why exec() stopped before its budget ran out.
+typedef enum {
+   STOP_NONE = 0,
+   STOP_JAM,        //Executed a JAM opcode. PC is past it.
+   STOP_UNSTABLE    //Executed an unstable undocumented opcode. PC is past it.
+} StopReason;
+
+//Register file. Only state exec() touches on every instruction lives here
+//and the whole struct fits one cache line. Flags are plain 0/1 bytes; Z and
+//N are kept as the last result and derived on read, and SP is the offset
+//into page 1. Use the accessors below rather than the fields for flags,
+//PS and SP. Cold per-run data (debug, statistics) does not belong here.
+struct CPU {
+   _Alignas(64) word pc;
+   byte sp;
    byte a;
    byte x;
    byte y;
-   byte ps;
 
-   byte c : 1;
-   byte z : 1;
-   byte i : 1;
-   byte d : 1;
-   byte b : 1;
-   byte v : 1;
-   byte n : 1;
+   byte c;
+   byte v;
+   byte i;
+   byte d;
+   byte b;
+   byte zRes;
+   byte nRes;
 
-   uint32_t cycles;
+   byte stop;         //StopReason. exec() does nothing until it is cleared.
+
+   uint64_t cycles;   //Running total; does not wrap in practice.
 };
 
 void reset_cpu(struct CPU* cpu, word sPC);
 struct RAM* init_ram();
 void free_ram(struct RAM* ram);
+int init_decode_cache(struct RAM* ram);
+void flush_decode_cache(struct RAM* ram);
+//Map pageCount pages starting at firstPage to host memory, to read-only host
+//memory, or to I/O handlers (either may be NULL: reads then return 0xFF and
+//writes are dropped). unmap_pages() maps pages back to data. Decoded and
+//compiled code is flushed. Return 0 on success. I/O handlers run in the
+//middle of exec(), when the CPU struct passed to it may not be current yet.
+int map_ram(struct RAM* ram, byte firstPage, uint32_t pageCount, byte* mem);
+int map_rom(struct RAM* ram, byte firstPage, uint32_t pageCount, const byte* rom);
+int map_io(struct RAM* ram, byte firstPage, uint32_t pageCount, IoRead read, IoWrite write, void* ctx);
+void unmap_pages(struct RAM* ram, byte firstPage, uint32_t pageCount);
+//Snapshots hold the CPU and the RAM pages of a RAM; ROM and I/O pages are
+//left out. Taking one copies the pages written since the last snapshot and
+//shares the rest, and restoring one only copies back pages that differ, so
+//both cost O(dirty pages). Pages stay in place, but a snapshot leaves them
+//write-protected until each is next written: the JIT stays off until then,
+//and writing to data directly in the meantime is not seen by later
+//snapshots. Restoring skips pages since
+//remapped as ROM or I/O. Refcounts are not atomic: keep a snapshot and the
+//RAMs it is restored into on one thread.
+struct Snapshot* take_snapshot(struct RAM* ram, const struct CPU* cpu);
+void restore_snapshot(struct RAM* ram, struct CPU* cpu, const struct Snapshot* snap);
+void free_snapshot(struct Snapshot* snap);
+//Bytes snap holds that it does not share with from, the snapshot itself
+//included: what keeping both costs over keeping from. from may be NULL.
+size_t snapshot_delta_size(const struct Snapshot* snap, const struct Snapshot* from);
+//Dirty-page tracking. With CPU_DIRTY_PAGES defined, every write through
+//the bus sets the bit of its page, I/O pages excepted, and so does a
+//restore_snapshot() that changes a page. ROM pages get marked too when
+//written to. Other builds leave the bitmap clear. Writing to ram->data
+//directly is not tracked.
+bool is_page_dirty(const struct RAM* ram, byte page);
+//Returns the first dirty page at or after page, or PAGE_COUNT if none is:
+//for (uint32_t p = next_dirty_page(ram, 0); p < PAGE_COUNT; p = next_dirty_page(ram, p + 1))
+uint32_t next_dirty_page(const struct RAM* ram, uint32_t page);
+void clear_dirty_pages(struct RAM* ram);
+//Sets the dirty bit of the page addr is in, for the write paths of the
+//engines. Compiles to nothing unless CPU_DIRTY_PAGES is defined.
+static inline void mark_dirty(struct RAM* ram, word addr) {
+#ifdef CPU_DIRTY_PAGES
+   ram->dirtyPages[addr >> 11] |= (byte)(1 << ((addr >> 8) & 7));
+#else
+   (void)ram;
+   (void)addr;
+#endif // CPU_DIRTY_PAGES
+}
+//Reads and writes through the page table without counting cycles.
+byte bus_read(const struct RAM* ram, word addr);
+void bus_write(struct RAM* ram, word addr, byte val);
+//Copies len bytes to addr and up, wrapping at $FFFF. RAM pages are copied
+//whole instead of byte by byte.
+void bus_write_block(struct RAM* ram, word addr, const byte* src, uint32_t len);
+//Runs insCount instructions. Returns 0, or 1 if the CPU stopped early;
+//cpu->stop then tells why.
 int exec(struct CPU* cpu, struct RAM* ram, uint32_t insCount);
+//Functional variant of exec(): the same instructions and results, but the
+//interpreter does no cycle bookkeeping and leaves cpu->cycles unchanged.
+//Compiled blocks and the profiler still count cycles.
+int exec_fast(struct CPU* cpu, struct RAM* ram, uint32_t insCount);
+//Runs until budget cycles have passed, finishing the instruction that
+//crosses the line. Returns the cycles run minus budget: the overshoot, or a
+//negative number if the CPU stopped early. A CPU that stops on the
+//instruction crossing the line returns the overshoot too, so check
+//cpu->stop to tell whether it stopped. With a scheduler attached it
+//also runs device events and takes IRQs and NMIs, between instructions.
+int64_t exec_cycles(struct CPU* cpu, struct RAM* ram, int64_t budget);
+
+byte get_flag(const struct CPU* cpu, StatusFlag flag);
+void set_flag(struct CPU* cpu, StatusFlag flag, byte val);
+byte get_ps(const struct CPU* cpu);
+void set_ps(struct CPU* cpu, byte ps);
+word get_sp(const struct CPU* cpu);
+void set_sp(struct CPU* cpu, word sp);
 
 #endif // CPU_H
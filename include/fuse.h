@@ -0,0 +1,43 @@
+#pragma once
+#ifndef FUSE_H
+#define FUSE_H
+
+#include "cpu.h"
+
+//Instruction runs that the decode cache executes in one dispatch. Each is
+//   X2(first, second) or X3(first, second, third)
+//of opcode names from ins.h. All but the last instruction must fall
+//through to the next one, and a third instruction must have no operand.
+//The first match wins, so longer runs go before shorter ones they start.
+#define FUSE_SPAN_MAX 7   //Bytes covered by the longest run.
+#define FUSE_LIST(X2, X3) \
+   X2(LDA_IM, STA_ABS) \
+   X2(LDA_ABS, STA_ABS) \
+   X3(LDA_ABSX, STA_ABSX, INX) \
+   X2(DEX, BNE)
+
+#define FUSE_KIND2(a, b) FUSE_##a##_##b,
+#define FUSE_KIND3(a, b, c) FUSE_##a##_##b##_##c,
+typedef enum {
+   FUSE_NONE = 0,
+   FUSE_LIST(FUSE_KIND2, FUSE_KIND3)
+   FUSE_COUNT
+} FuseKind;
+#undef FUSE_KIND3
+#undef FUSE_KIND2
+
+struct FuseInfo {
+   byte insCount;
+   const char* name;   //Opcode names joined by '+'.
+};
+
+#define FUSE_INFO2(a, b) [FUSE_##a##_##b] = { 2, #a "+" #b },
+#define FUSE_INFO3(a, b, c) [FUSE_##a##_##b##_##c] = { 3, #a "+" #b "+" #c },
+static const struct FuseInfo fuseInfo[FUSE_COUNT] = {
+   [FUSE_NONE] = { 1, "" },
+   FUSE_LIST(FUSE_INFO2, FUSE_INFO3)
+};
+#undef FUSE_INFO3
+#undef FUSE_INFO2
+
+#endif // FUSE_H
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef HOOKS_H
+#define HOOKS_H
+
+//Instrumentation hooks called by the interpreter, selected at compile time.
+//Define CPU_HOOKS as the name of a header (-DCPU_HOOKS=\"my_hooks.h\") that
+//defines any of the macros below, usually as calls to static inline
+//functions. Hooks left undefined compile to nothing. _DEBUG builds without
+//CPU_HOOKS use hooks_debug.h.
+//
+//   CPU_ON_FETCH(cpu, ram, opCode)  Instruction at cpu->pc about to run.
+//   CPU_ON_READ(ram, addr, val)     Data read by an instruction.
+//   CPU_ON_WRITE(ram, addr, val)    Data write by an instruction.
+//   CPU_ON_PUSH(ram, sp, val)       Stack push; sp is the new stack pointer.
+//   CPU_ON_POP(ram, sp, val)        Stack pop; sp is the slot popped from.
+//   CPU_ON_FLAGS(cpu)               Flags set by an instruction helper.
+//
+//ram is a const struct RAM*, cpu a const struct CPU* holding the current
+//registers; in threaded builds it is the engine's local copy of the CPU
+//passed to exec(), which is only written back on return. Stack accesses are
+//only reported to the push/pop hooks. Compiled code does not call hooks,
+//so builds with CPU_HOOKS always interpret.
+
+#ifdef CPU_HOOKS
+#define CPU_HOOKS_ENABLED 1
+#include CPU_HOOKS
+#else
+#define CPU_HOOKS_ENABLED 0
+#ifdef _DEBUG
+#include "hooks_debug.h"
+#endif // _DEBUG
+#endif // CPU_HOOKS
+
+#ifndef CPU_ON_FETCH
+#define CPU_ON_FETCH(cpu, ram, opCode) ((void)(cpu), (void)(ram), (void)(opCode))
+#endif
+#ifndef CPU_ON_READ
+#define CPU_ON_READ(ram, addr, val) ((void)(ram), (void)(addr), (void)(val))
+#endif
+#ifndef CPU_ON_WRITE
+#define CPU_ON_WRITE(ram, addr, val) ((void)(ram), (void)(addr), (void)(val))
+#endif
+#ifndef CPU_ON_PUSH
+#define CPU_ON_PUSH(ram, sp, val) ((void)(ram), (void)(sp), (void)(val))
+#endif
+#ifndef CPU_ON_POP
+#define CPU_ON_POP(ram, sp, val) ((void)(ram), (void)(sp), (void)(val))
+#endif
+#ifndef CPU_ON_FLAGS
+#define CPU_ON_FLAGS(cpu) ((void)(cpu))
+#endif
+
+#endif // HOOKS_H
@@ -0,0 +1,33 @@
+#pragma once
+#ifndef HOOKS_DEBUG_H
+#define HOOKS_DEBUG_H
+
+//Hooks for _DEBUG builds: print every event. See hooks.h.
+
+#include "cpu.h"
+#include <stdio.h>
+
+static inline void debug_on_fetch(const struct CPU* cpu, byte opCode) {
+   printf_s("DEBUG\t| Fetched [0x%X] at [0x%X]\n", opCode, cpu->pc);
+}
+
+static inline void debug_on_access(const char* what, word addr, byte val) {
+   printf_s("DEBUG\t| %s [0x%X] at [0x%X]\n", what, val, addr);
+}
+
+static inline void debug_on_stack(const char* what, byte sp, byte val) {
+   printf_s("DEBUG\t| %s [0x%X]. Current SP: [0x%X]\n", what, val, sp);
+}
+
+static inline void debug_on_flags(const struct CPU* cpu) {
+   printf_s("DEBUG\t| Set Flags: ZN result: [0x%X], C: [0x%X], V: [0x%X]\n", cpu->zRes, cpu->c, cpu->v);
+}
+
+#define CPU_ON_FETCH(cpu, ram, opCode) ((void)(ram), debug_on_fetch((cpu), (opCode)))
+#define CPU_ON_READ(ram, addr, val) ((void)(ram), debug_on_access("Read", (addr), (val)))
+#define CPU_ON_WRITE(ram, addr, val) ((void)(ram), debug_on_access("Wrote", (addr), (val)))
+#define CPU_ON_PUSH(ram, sp, val) ((void)(ram), debug_on_stack("Pushed", (sp), (val)))
+#define CPU_ON_POP(ram, sp, val) ((void)(ram), debug_on_stack("Popped", (sp), (val)))
+#define CPU_ON_FLAGS(cpu) debug_on_flags(cpu)
+
+#endif // HOOKS_DEBUG_H
@@ -2,111 +2,303 @@
 #ifndef INS_H
 #define INS_H
 
-#define JSR 0x20        //Jump to Subroutine. Takes 6 cycles.
-#define RTS 0x60        //Returns to the calling routine. Takes 6 cycles.
+//Instruction set. Every opcode is one entry
+//   X(name, opcode, kind, reg, src, mode, cycles)
+//kind     operation, expanded by the interpreter core and optable.h.
+//reg      register loaded, stored or written (G_A, G_X, G_Y).
+//src      source register of transfers.
+//mode     addressing mode (MODE_*), which fixes the operand length.
+//cycles   base cycles. Reads in MODE_ABSX, MODE_ABSY and MODE_INDY take
+//         one more when the index crosses a page, taken branches one more
+//         and another one when they land in another page.
+//All 256 opcodes are listed: the official set, the stable undocumented
+//NMOS opcodes, JAM, which halts the CPU, and the unstable undocumented
+//ones as TRAP, which stop it too rather than guess at analog behavior.
+//Both stop after their opcode and operand fetches, which is all their
+//cycles count. BRK fetches its padding byte as an immediate operand.
+//The list generates the opcode constants below, the interpreter's
+//handlers and dispatch tables and the operation table of the compiling
+//engines.
+#define INS_LIST(X) \
+   X(JSR,      0x20, JSR, G_A, G_A, MODE_ABS,  6) \
+   X(RTS,      0x60, RTS, G_A, G_A, MODE_IMP,  6) \
+   X(JMP_ABS,  0x4C, JMP, G_A, G_A, MODE_ABS,  3) \
+   X(JMP_IND,  0x6C, JMP, G_A, G_A, MODE_IND,  5) \
+   X(BRK,      0x00, BRK, G_A, G_A, MODE_IMM,  7) \
+   X(RTI,      0x40, RTI, G_A, G_A, MODE_IMP,  6) \
+   \
+   X(BPL,      0x10, BPL, G_A, G_A, MODE_REL,  2) \
+   X(BMI,      0x30, BMI, G_A, G_A, MODE_REL,  2) \
+   X(BVC,      0x50, BVC, G_A, G_A, MODE_REL,  2) \
+   X(BVS,      0x70, BVS, G_A, G_A, MODE_REL,  2) \
+   X(BCC,      0x90, BCC, G_A, G_A, MODE_REL,  2) \
+   X(BCS,      0xB0, BCS, G_A, G_A, MODE_REL,  2) \
+   X(BNE,      0xD0, BNE, G_A, G_A, MODE_REL,  2) \
+   X(BEQ,      0xF0, BEQ, G_A, G_A, MODE_REL,  2) \
+   \
+   X(ADC_IM,   0x69, ADC, G_A, G_A, MODE_IMM,  2) \
+   X(ADC_ZP,   0x65, ADC, G_A, G_A, MODE_ZP,   3) \
+   X(ADC_ZPX,  0x75, ADC, G_A, G_A, MODE_ZPX,  4) \
+   X(ADC_ABS,  0x6D, ADC, G_A, G_A, MODE_ABS,  4) \
+   X(ADC_ABSX, 0x7D, ADC, G_A, G_A, MODE_ABSX, 4) \
+   X(ADC_ABSY, 0x79, ADC, G_A, G_A, MODE_ABSY, 4) \
+   X(ADC_INDX, 0x61, ADC, G_A, G_A, MODE_INDX, 6) \
+   X(ADC_INDY, 0x71, ADC, G_A, G_A, MODE_INDY, 5) \
+   \
+   X(SBC_IM,   0xE9, SBC, G_A, G_A, MODE_IMM,  2) \
+   X(SBC_ZP,   0xE5, SBC, G_A, G_A, MODE_ZP,   3) \
+   X(SBC_ZPX,  0xF5, SBC, G_A, G_A, MODE_ZPX,  4) \
+   X(SBC_ABS,  0xED, SBC, G_A, G_A, MODE_ABS,  4) \
+   X(SBC_ABSX, 0xFD, SBC, G_A, G_A, MODE_ABSX, 4) \
+   X(SBC_ABSY, 0xF9, SBC, G_A, G_A, MODE_ABSY, 4) \
+   X(SBC_INDX, 0xE1, SBC, G_A, G_A, MODE_INDX, 6) \
+   X(SBC_INDY, 0xF1, SBC, G_A, G_A, MODE_INDY, 5) \
+   X(SBC_EB,   0xEB, SBC, G_A, G_A, MODE_IMM,  2) \
+   \
+   X(LDA_IM,   0xA9, LD,  G_A, G_A, MODE_IMM,  2) \
+   X(LDA_ZP,   0xA5, LD,  G_A, G_A, MODE_ZP,   3) \
+   X(LDA_ZPX,  0xB5, LD,  G_A, G_A, MODE_ZPX,  4) \
+   X(LDA_ABS,  0xAD, LD,  G_A, G_A, MODE_ABS,  4) \
+   X(LDA_ABSX, 0xBD, LD,  G_A, G_A, MODE_ABSX, 4) \
+   X(LDA_ABSY, 0xB9, LD,  G_A, G_A, MODE_ABSY, 4) \
+   X(LDA_INDX, 0xA1, LD,  G_A, G_A, MODE_INDX, 6) \
+   X(LDA_INDY, 0xB1, LD,  G_A, G_A, MODE_INDY, 5) \
+   \
+   X(LDX_IM,   0xA2, LD,  G_X, G_X, MODE_IMM,  2) \
+   X(LDX_ZP,   0xA6, LD,  G_X, G_X, MODE_ZP,   3) \
+   X(LDX_ZPY,  0xB6, LD,  G_X, G_X, MODE_ZPY,  4) \
+   X(LDX_ABS,  0xAE, LD,  G_X, G_X, MODE_ABS,  4) \
+   X(LDX_ABSY, 0xBE, LD,  G_X, G_X, MODE_ABSY, 4) \
+   X(LDY_IM,   0xA0, LD,  G_Y, G_Y, MODE_IMM,  2) \
+   X(LDY_ZP,   0xA4, LD,  G_Y, G_Y, MODE_ZP,   3) \
+   X(LDY_ZPX,  0xB4, LD,  G_Y, G_Y, MODE_ZPX,  4) \
+   X(LDY_ABS,  0xAC, LD,  G_Y, G_Y, MODE_ABS,  4) \
+   X(LDY_ABSX, 0xBC, LD,  G_Y, G_Y, MODE_ABSX, 4) \
+   \
+   X(STA_ZP,   0x85, ST,  G_A, G_A, MODE_ZP,   3) \
+   X(STA_ZPX,  0x95, ST,  G_A, G_A, MODE_ZPX,  4) \
+   X(STA_ABS,  0x8D, ST,  G_A, G_A, MODE_ABS,  4) \
+   X(STA_ABSX, 0x9D, ST,  G_A, G_A, MODE_ABSX, 5) \
+   X(STA_ABSY, 0x99, ST,  G_A, G_A, MODE_ABSY, 5) \
+   X(STA_INDX, 0x81, ST,  G_A, G_A, MODE_INDX, 6) \
+   X(STA_INDY, 0x91, ST,  G_A, G_A, MODE_INDY, 6) \
+   X(STX_ZP,   0x86, ST,  G_X, G_X, MODE_ZP,   3) \
+   X(STX_ZPY,  0x96, ST,  G_X, G_X, MODE_ZPY,  4) \
+   X(STX_ABS,  0x8E, ST,  G_X, G_X, MODE_ABS,  4) \
+   X(STY_ZP,   0x84, ST,  G_Y, G_Y, MODE_ZP,   3) \
+   X(STY_ZPX,  0x94, ST,  G_Y, G_Y, MODE_ZPX,  4) \
+   X(STY_ABS,  0x8C, ST,  G_Y, G_Y, MODE_ABS,  4) \
+   \
+   X(TAX,      0xAA, TR,  G_X, G_A, MODE_IMP,  2) \
+   X(TXA,      0x8A, TR,  G_A, G_X, MODE_IMP,  2) \
+   X(TAY,      0xA8, TR,  G_Y, G_A, MODE_IMP,  2) \
+   X(TYA,      0x98, TR,  G_A, G_Y, MODE_IMP,  2) \
+   \
+   X(TSX,      0xBA, TSX, G_X, G_X, MODE_IMP,  2) \
+   X(TXS,      0x9A, TXS, G_X, G_X, MODE_IMP,  2) \
+   X(PHA,      0x48, PHA, G_A, G_A, MODE_IMP,  3) \
+   X(PHP,      0x08, PHP, G_A, G_A, MODE_IMP,  3) \
+   X(PLA,      0x68, PLA, G_A, G_A, MODE_IMP,  4) \
+   X(PLP,      0x28, PLP, G_A, G_A, MODE_IMP,  4) \
+   \
+   X(AND_IM,   0x29, AND, G_A, G_A, MODE_IMM,  2) \
+   X(AND_ZP,   0x25, AND, G_A, G_A, MODE_ZP,   3) \
+   X(AND_ZPX,  0x35, AND, G_A, G_A, MODE_ZPX,  4) \
+   X(AND_ABS,  0x2D, AND, G_A, G_A, MODE_ABS,  4) \
+   X(AND_ABSX, 0x3D, AND, G_A, G_A, MODE_ABSX, 4) \
+   X(AND_ABSY, 0x39, AND, G_A, G_A, MODE_ABSY, 4) \
+   X(AND_INDX, 0x21, AND, G_A, G_A, MODE_INDX, 6) \
+   X(AND_INDY, 0x31, AND, G_A, G_A, MODE_INDY, 5) \
+   X(EOR_IM,   0x49, EOR, G_A, G_A, MODE_IMM,  2) \
+   X(EOR_ZP,   0x45, EOR, G_A, G_A, MODE_ZP,   3) \
+   X(EOR_ZPX,  0x55, EOR, G_A, G_A, MODE_ZPX,  4) \
+   X(EOR_ABS,  0x4D, EOR, G_A, G_A, MODE_ABS,  4) \
+   X(EOR_ABSX, 0x5D, EOR, G_A, G_A, MODE_ABSX, 4) \
+   X(EOR_ABSY, 0x59, EOR, G_A, G_A, MODE_ABSY, 4) \
+   X(EOR_INDX, 0x41, EOR, G_A, G_A, MODE_INDX, 6) \
+   X(EOR_INDY, 0x51, EOR, G_A, G_A, MODE_INDY, 5) \
+   X(ORA_IM,   0x09, ORA, G_A, G_A, MODE_IMM,  2) \
+   X(ORA_ZP,   0x05, ORA, G_A, G_A, MODE_ZP,   3) \
+   X(ORA_ZPX,  0x15, ORA, G_A, G_A, MODE_ZPX,  4) \
+   X(ORA_ABS,  0x0D, ORA, G_A, G_A, MODE_ABS,  4) \
+   X(ORA_ABSX, 0x1D, ORA, G_A, G_A, MODE_ABSX, 4) \
+   X(ORA_ABSY, 0x19, ORA, G_A, G_A, MODE_ABSY, 4) \
+   X(ORA_INDX, 0x01, ORA, G_A, G_A, MODE_INDX, 6) \
+   X(ORA_INDY, 0x11, ORA, G_A, G_A, MODE_INDY, 5) \
+   X(BIT_ZP,   0x24, BIT, G_A, G_A, MODE_ZP,   3) \
+   X(BIT_ABS,  0x2C, BIT, G_A, G_A, MODE_ABS,  4) \
+   \
+   X(CMP_IM,   0xC9, CMP, G_A, G_A, MODE_IMM,  2) \
+   X(CMP_ZP,   0xC5, CMP, G_A, G_A, MODE_ZP,   3) \
+   X(CMP_ZPX,  0xD5, CMP, G_A, G_A, MODE_ZPX,  4) \
+   X(CMP_ABS,  0xCD, CMP, G_A, G_A, MODE_ABS,  4) \
+   X(CMP_ABSX, 0xDD, CMP, G_A, G_A, MODE_ABSX, 4) \
+   X(CMP_ABSY, 0xD9, CMP, G_A, G_A, MODE_ABSY, 4) \
+   X(CMP_INDX, 0xC1, CMP, G_A, G_A, MODE_INDX, 6) \
+   X(CMP_INDY, 0xD1, CMP, G_A, G_A, MODE_INDY, 5) \
+   X(CPX_IM,   0xE0, CMP, G_X, G_X, MODE_IMM,  2) \
+   X(CPX_ZP,   0xE4, CMP, G_X, G_X, MODE_ZP,   3) \
+   X(CPX_ABS,  0xEC, CMP, G_X, G_X, MODE_ABS,  4) \
+   X(CPY_IM,   0xC0, CMP, G_Y, G_Y, MODE_IMM,  2) \
+   X(CPY_ZP,   0xC4, CMP, G_Y, G_Y, MODE_ZP,   3) \
+   X(CPY_ABS,  0xCC, CMP, G_Y, G_Y, MODE_ABS,  4) \
+   \
+   X(ASL_ACC,  0x0A, ASL, G_A, G_A, MODE_ACC,  2) \
+   X(ASL_ZP,   0x06, ASL, G_A, G_A, MODE_ZP,   5) \
+   X(ASL_ZPX,  0x16, ASL, G_A, G_A, MODE_ZPX,  6) \
+   X(ASL_ABS,  0x0E, ASL, G_A, G_A, MODE_ABS,  6) \
+   X(ASL_ABSX, 0x1E, ASL, G_A, G_A, MODE_ABSX, 7) \
+   X(LSR_ACC,  0x4A, LSR, G_A, G_A, MODE_ACC,  2) \
+   X(LSR_ZP,   0x46, LSR, G_A, G_A, MODE_ZP,   5) \
+   X(LSR_ZPX,  0x56, LSR, G_A, G_A, MODE_ZPX,  6) \
+   X(LSR_ABS,  0x4E, LSR, G_A, G_A, MODE_ABS,  6) \
+   X(LSR_ABSX, 0x5E, LSR, G_A, G_A, MODE_ABSX, 7) \
+   X(ROL_ACC,  0x2A, ROL, G_A, G_A, MODE_ACC,  2) \
+   X(ROL_ZP,   0x26, ROL, G_A, G_A, MODE_ZP,   5) \
+   X(ROL_ZPX,  0x36, ROL, G_A, G_A, MODE_ZPX,  6) \
+   X(ROL_ABS,  0x2E, ROL, G_A, G_A, MODE_ABS,  6) \
+   X(ROL_ABSX, 0x3E, ROL, G_A, G_A, MODE_ABSX, 7) \
+   X(ROR_ACC,  0x6A, ROR, G_A, G_A, MODE_ACC,  2) \
+   X(ROR_ZP,   0x66, ROR, G_A, G_A, MODE_ZP,   5) \
+   X(ROR_ZPX,  0x76, ROR, G_A, G_A, MODE_ZPX,  6) \
+   X(ROR_ABS,  0x6E, ROR, G_A, G_A, MODE_ABS,  6) \
+   X(ROR_ABSX, 0x7E, ROR, G_A, G_A, MODE_ABSX, 7) \
+   \
+   X(INC_ZP,   0xE6, INC, G_A, G_A, MODE_ZP,   5) \
+   X(INC_ZPX,  0xF6, INC, G_A, G_A, MODE_ZPX,  6) \
+   X(INC_ABS,  0xEE, INC, G_A, G_A, MODE_ABS,  6) \
+   X(INC_ABSX, 0xFE, INC, G_A, G_A, MODE_ABSX, 7) \
+   X(DEC_ZP,   0xC6, DEC, G_A, G_A, MODE_ZP,   5) \
+   X(DEC_ZPX,  0xD6, DEC, G_A, G_A, MODE_ZPX,  6) \
+   X(DEC_ABS,  0xCE, DEC, G_A, G_A, MODE_ABS,  6) \
+   X(DEC_ABSX, 0xDE, DEC, G_A, G_A, MODE_ABSX, 7) \
+   X(INX,      0xE8, INCR, G_X, G_X, MODE_IMP,  2) \
+   X(INY,      0xC8, INCR, G_Y, G_Y, MODE_IMP,  2) \
+   X(DEX,      0xCA, DECR, G_X, G_X, MODE_IMP,  2) \
+   X(DEY,      0x88, DECR, G_Y, G_Y, MODE_IMP,  2) \
+   \
+   X(CLC,      0x18, CLC, G_A, G_A, MODE_IMP,  2) \
+   X(SEC,      0x38, SEC, G_A, G_A, MODE_IMP,  2) \
+   X(CLI,      0x58, CLI, G_A, G_A, MODE_IMP,  2) \
+   X(SEI,      0x78, SEI, G_A, G_A, MODE_IMP,  2) \
+   X(CLV,      0xB8, CLV, G_A, G_A, MODE_IMP,  2) \
+   X(CLD,      0xD8, CLD, G_A, G_A, MODE_IMP,  2) \
+   X(SED,      0xF8, SED, G_A, G_A, MODE_IMP,  2) \
+   X(NOP,      0xEA, NOP, G_A, G_A, MODE_IMP,  2) \
+   \
+   X(SLO_ZP,   0x07, SLO, G_A, G_A, MODE_ZP,   5) \
+   X(SLO_ZPX,  0x17, SLO, G_A, G_A, MODE_ZPX,  6) \
+   X(SLO_ABS,  0x0F, SLO, G_A, G_A, MODE_ABS,  6) \
+   X(SLO_ABSX, 0x1F, SLO, G_A, G_A, MODE_ABSX, 7) \
+   X(SLO_ABSY, 0x1B, SLO, G_A, G_A, MODE_ABSY, 7) \
+   X(SLO_INDX, 0x03, SLO, G_A, G_A, MODE_INDX, 8) \
+   X(SLO_INDY, 0x13, SLO, G_A, G_A, MODE_INDY, 8) \
+   X(RLA_ZP,   0x27, RLA, G_A, G_A, MODE_ZP,   5) \
+   X(RLA_ZPX,  0x37, RLA, G_A, G_A, MODE_ZPX,  6) \
+   X(RLA_ABS,  0x2F, RLA, G_A, G_A, MODE_ABS,  6) \
+   X(RLA_ABSX, 0x3F, RLA, G_A, G_A, MODE_ABSX, 7) \
+   X(RLA_ABSY, 0x3B, RLA, G_A, G_A, MODE_ABSY, 7) \
+   X(RLA_INDX, 0x23, RLA, G_A, G_A, MODE_INDX, 8) \
+   X(RLA_INDY, 0x33, RLA, G_A, G_A, MODE_INDY, 8) \
+   X(SRE_ZP,   0x47, SRE, G_A, G_A, MODE_ZP,   5) \
+   X(SRE_ZPX,  0x57, SRE, G_A, G_A, MODE_ZPX,  6) \
+   X(SRE_ABS,  0x4F, SRE, G_A, G_A, MODE_ABS,  6) \
+   X(SRE_ABSX, 0x5F, SRE, G_A, G_A, MODE_ABSX, 7) \
+   X(SRE_ABSY, 0x5B, SRE, G_A, G_A, MODE_ABSY, 7) \
+   X(SRE_INDX, 0x43, SRE, G_A, G_A, MODE_INDX, 8) \
+   X(SRE_INDY, 0x53, SRE, G_A, G_A, MODE_INDY, 8) \
+   X(RRA_ZP,   0x67, RRA, G_A, G_A, MODE_ZP,   5) \
+   X(RRA_ZPX,  0x77, RRA, G_A, G_A, MODE_ZPX,  6) \
+   X(RRA_ABS,  0x6F, RRA, G_A, G_A, MODE_ABS,  6) \
+   X(RRA_ABSX, 0x7F, RRA, G_A, G_A, MODE_ABSX, 7) \
+   X(RRA_ABSY, 0x7B, RRA, G_A, G_A, MODE_ABSY, 7) \
+   X(RRA_INDX, 0x63, RRA, G_A, G_A, MODE_INDX, 8) \
+   X(RRA_INDY, 0x73, RRA, G_A, G_A, MODE_INDY, 8) \
+   X(DCP_ZP,   0xC7, DCP, G_A, G_A, MODE_ZP,   5) \
+   X(DCP_ZPX,  0xD7, DCP, G_A, G_A, MODE_ZPX,  6) \
+   X(DCP_ABS,  0xCF, DCP, G_A, G_A, MODE_ABS,  6) \
+   X(DCP_ABSX, 0xDF, DCP, G_A, G_A, MODE_ABSX, 7) \
+   X(DCP_ABSY, 0xDB, DCP, G_A, G_A, MODE_ABSY, 7) \
+   X(DCP_INDX, 0xC3, DCP, G_A, G_A, MODE_INDX, 8) \
+   X(DCP_INDY, 0xD3, DCP, G_A, G_A, MODE_INDY, 8) \
+   X(ISC_ZP,   0xE7, ISC, G_A, G_A, MODE_ZP,   5) \
+   X(ISC_ZPX,  0xF7, ISC, G_A, G_A, MODE_ZPX,  6) \
+   X(ISC_ABS,  0xEF, ISC, G_A, G_A, MODE_ABS,  6) \
+   X(ISC_ABSX, 0xFF, ISC, G_A, G_A, MODE_ABSX, 7) \
+   X(ISC_ABSY, 0xFB, ISC, G_A, G_A, MODE_ABSY, 7) \
+   X(ISC_INDX, 0xE3, ISC, G_A, G_A, MODE_INDX, 8) \
+   X(ISC_INDY, 0xF3, ISC, G_A, G_A, MODE_INDY, 8) \
+   \
+   X(SAX_ZP,   0x87, SAX, G_A, G_A, MODE_ZP,   3) \
+   X(SAX_ZPY,  0x97, SAX, G_A, G_A, MODE_ZPY,  4) \
+   X(SAX_ABS,  0x8F, SAX, G_A, G_A, MODE_ABS,  4) \
+   X(SAX_INDX, 0x83, SAX, G_A, G_A, MODE_INDX, 6) \
+   X(LAX_ZP,   0xA7, LAX, G_A, G_A, MODE_ZP,   3) \
+   X(LAX_ZPY,  0xB7, LAX, G_A, G_A, MODE_ZPY,  4) \
+   X(LAX_ABS,  0xAF, LAX, G_A, G_A, MODE_ABS,  4) \
+   X(LAX_ABSY, 0xBF, LAX, G_A, G_A, MODE_ABSY, 4) \
+   X(LAX_INDX, 0xA3, LAX, G_A, G_A, MODE_INDX, 6) \
+   X(LAX_INDY, 0xB3, LAX, G_A, G_A, MODE_INDY, 5) \
+   X(ANC_0B,   0x0B, ANC, G_A, G_A, MODE_IMM,  2) \
+   X(ANC_2B,   0x2B, ANC, G_A, G_A, MODE_IMM,  2) \
+   X(ALR_IM,   0x4B, ALR, G_A, G_A, MODE_IMM,  2) \
+   X(ARR_IM,   0x6B, ARR, G_A, G_A, MODE_IMM,  2) \
+   X(SBX_IM,   0xCB, SBX, G_X, G_X, MODE_IMM,  2) \
+   X(LAS_ABSY, 0xBB, LAS, G_A, G_A, MODE_ABSY, 4) \
+   \
+   X(NOP_1A,   0x1A, NOP, G_A, G_A, MODE_IMP,  2) \
+   X(NOP_3A,   0x3A, NOP, G_A, G_A, MODE_IMP,  2) \
+   X(NOP_5A,   0x5A, NOP, G_A, G_A, MODE_IMP,  2) \
+   X(NOP_7A,   0x7A, NOP, G_A, G_A, MODE_IMP,  2) \
+   X(NOP_DA,   0xDA, NOP, G_A, G_A, MODE_IMP,  2) \
+   X(NOP_FA,   0xFA, NOP, G_A, G_A, MODE_IMP,  2) \
+   X(NOP_80,   0x80, SKP, G_A, G_A, MODE_IMM,  2) \
+   X(NOP_82,   0x82, SKP, G_A, G_A, MODE_IMM,  2) \
+   X(NOP_89,   0x89, SKP, G_A, G_A, MODE_IMM,  2) \
+   X(NOP_C2,   0xC2, SKP, G_A, G_A, MODE_IMM,  2) \
+   X(NOP_E2,   0xE2, SKP, G_A, G_A, MODE_IMM,  2) \
+   X(NOP_04,   0x04, SKP, G_A, G_A, MODE_ZP,   3) \
+   X(NOP_44,   0x44, SKP, G_A, G_A, MODE_ZP,   3) \
+   X(NOP_64,   0x64, SKP, G_A, G_A, MODE_ZP,   3) \
+   X(NOP_14,   0x14, SKP, G_A, G_A, MODE_ZPX,  4) \
+   X(NOP_34,   0x34, SKP, G_A, G_A, MODE_ZPX,  4) \
+   X(NOP_54,   0x54, SKP, G_A, G_A, MODE_ZPX,  4) \
+   X(NOP_74,   0x74, SKP, G_A, G_A, MODE_ZPX,  4) \
+   X(NOP_D4,   0xD4, SKP, G_A, G_A, MODE_ZPX,  4) \
+   X(NOP_F4,   0xF4, SKP, G_A, G_A, MODE_ZPX,  4) \
+   X(NOP_0C,   0x0C, SKP, G_A, G_A, MODE_ABS,  4) \
+   X(NOP_1C,   0x1C, SKP, G_A, G_A, MODE_ABSX, 4) \
+   X(NOP_3C,   0x3C, SKP, G_A, G_A, MODE_ABSX, 4) \
+   X(NOP_5C,   0x5C, SKP, G_A, G_A, MODE_ABSX, 4) \
+   X(NOP_7C,   0x7C, SKP, G_A, G_A, MODE_ABSX, 4) \
+   X(NOP_DC,   0xDC, SKP, G_A, G_A, MODE_ABSX, 4) \
+   X(NOP_FC,   0xFC, SKP, G_A, G_A, MODE_ABSX, 4) \
+   \
+   X(JAM,      0x02, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_12,   0x12, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_22,   0x22, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_32,   0x32, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_42,   0x42, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_52,   0x52, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_62,   0x62, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_72,   0x72, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_92,   0x92, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_B2,   0xB2, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_D2,   0xD2, JAM, G_A, G_A, MODE_IMP,  1) \
+   X(JAM_F2,   0xF2, JAM, G_A, G_A, MODE_IMP,  1) \
+   \
+   X(ANE_IM,   0x8B, TRAP, G_A, G_A, MODE_IMM,  2) \
+   X(LXA_IM,   0xAB, TRAP, G_A, G_A, MODE_IMM,  2) \
+   X(SHA_ABSY, 0x9F, TRAP, G_A, G_A, MODE_ABSY, 3) \
+   X(SHA_INDY, 0x93, TRAP, G_A, G_A, MODE_INDY, 2) \
+   X(SHX_ABSY, 0x9E, TRAP, G_A, G_A, MODE_ABSY, 3) \
+   X(SHY_ABSX, 0x9C, TRAP, G_A, G_A, MODE_ABSX, 3) \
+   X(TAS_ABSY, 0x9B, TRAP, G_A, G_A, MODE_ABSY, 3)
 
-#pragma region ADC
+#define INS_CONSTANT(name, opcode, kind, reg, src, mode, cycles) name = opcode,
+enum {
+   INS_LIST(INS_CONSTANT)
+};
+#undef INS_CONSTANT
 
-#define ADC_IM 0x69     //ADC Immediate. Takes 2 cycles.
-#define ADC_ZP 0x65     //ADC Zero Page. Takes 3 cycles
-#define ADC_ZPX 0x75    //ADC Zero Page X. Takes 4 cycles.
-#define ADC_ABS 0xAD    //ADC Absolute. Takes 4 cycles.
-#define ADC_ABSX 0xBD   //ADC Absolute X. Takes 4(+1) cycles.
-#define ADC_ABSY 0xB9   //ADC Absolute Y. Takes 4(+1) cycles
-#define ADC_INDX 0xA1   //ADC Indirect X. Takes 6 cycles.
-#define ADC_INDY 0xB1   //ADC Indirect Y. Takes 5(+1) cycles.
-
-#pragma endregion
-#pragma region LD_OPCODES
-
-#define LDA_IM 0xA9     //Load accumulator (Immediate). Takes 2 cycles.
-#define LDA_ZP 0xA5     //Load accumulator (Zero page). Takes 3 cycles.
-#define LDA_ZPX 0xB5    //Load accumulator (Zero page X). Takes 4 cycles.
-#define LDA_ABS 0xAD    //Load accumulator (Absolute). Takes 4 cycles.
-#define LDA_ABSX 0xBD   //Load accumulator (Absolute X). Takes 4(+1) cycles.
-#define LDA_ABSY 0xB9   //Load accumulator (Absolute Y). Takes 4(+1) cycles
-#define LDA_INDX 0xA1   //Load accumulator (Indirect X). Takes 6 cycles.
-#define LDA_INDY 0xB1   //Load accumulator (Indirect Y). Takes 5(+1) cycles.
-
-#define LDX_IM 0xA2     //Load X (Immediate). Takes 2 cycles.
-#define LDX_ZP 0xA6     //Load X (Zero page). Takes 3 cycles.
-#define LDX_ZPY 0xB6    //Load X (Zero page Y). Takes 4 cycles.
-#define LDX_ABS 0xAE    //Load X (Absolute). Takes 4 cycles.
-#define LDX_ABSY 0xBE   //Load X (Absolute Y). Takes 4(+1) cycles   
-
-#define LDY_IM 0xA0     //Load Y (Immediate). Takes 2 cycles.
-#define LDY_ZP 0xA4     //Load Y (Zero page). Takes 3 cycles.
-#define LDY_ZPX 0xB4    //Load Y (Zero page X). Takes 4 cycles.
-#define LDY_ABS 0xAC    //Load Y (Absolute). Takes 4 cycles.
-#define LDY_ABSX 0xBC   //Load Y (Absolute X). Takes 4(+1) cycles 
-
-#define STA_ZP 0x85     //Store accumulator (Zero page). Takes 3 cycles.
-#define STA_ZPX 0x95    //Store accumulator (Zero page X). Takes 4 cycles.
-#define STA_ABS 0x8D    //Store accumulator (Absolute). Takes 4 cycles.
-#define STA_ABSX 0x9D   //Store accumulator (Absolute X). Takes 5 cycles.
-#define STA_ABSY 0x99   //Store accumulator (Absolute Y). Takes 5 cycles.
-#define STA_INDX 0x81   //Store accumulator (Indirect X). Takes 6 cycles.
-#define STA_INDY 0x91   //Store accumulator (Indirect Y). Takes 6 cycles.
-
-#define STX_ZP 0x86     //Store X (Zero page). Takes 3 cycles.
-#define STX_ZPY 0x96    //Store X (Zero page Y). Takes 4 cycles.
-#define STX_ABS 0x8E    //Store X (Absolute). Takes 4 cycles.
-
-#define STY_ZP 0x84     //Store Y (Zero page). Takes 3 cycles.
-#define STY_ZPX 0x94    //Store Y (Zero page Y). Takes 4 cycles.
-#define STY_ABS 0x8C    //Store Y (Absolute). Takes 4 cycles.
-
-#pragma endregion
-#pragma region REG_TRANSFERS
-
-#define TAX 0xAA        //Transfer accumulator to X. Takes 2 cycles.
-#define TXA 0x8A        //Transfer accumulator to Y. Takes 2 cycles.
-#define TAY 0xA8        //Transfer X to accumulator. Takes 2 cycles.
-#define TYA 0x98        //Transfer Y to accumulator. Takes 2 cycles.
-
-#pragma endregion
-#pragma region STACK_OPS
-
-#define TSX 0xBA        //Transfer SP to X. Takes 2 cycles.
-#define TXS 0x9A        //Transfer X to SP. Takes 2 cycles.
-#define PHA 0x48        //Push Accumulator. Takes 3 cycles.
-#define PHP 0x08        //Push Processor Status. Takes 3 cycles.
-#define PLA 0x68        //Pull Accumulator. Takes 4 cycles.
-#define PLP 0x28        //Pull Processor Status. Takes 4 cycles.
-
-#pragma endregion
-#pragma region LOGICAL
-
-#define AND_IM 0x29     //AND (Immediate). Takes 2 cycles.
-#define AND_ZP 0x25     //AND (Zero Page). Takes 3 cycles.
-#define AND_ZPX 0x35    //AND (Zero Page X). Takes 4 cycles.
-#define AND_ABS 0x2D    //AND (Absolute). Takes 4 cycles.
-#define AND_ABSX 0x3D   //AND (Absolute X). Takes 4(+1) cycles.
-#define AND_ABSY 0x39   //AND (Absolute Y). Takes 4(+1) cycles.
-#define AND_INDX 0x21   //AND (Indirect X). Takes 6 cycles.
-#define AND_INDY 0x31   //AND (Indirect Y). Takes 5(+1) cycles.
-
-#define EOR_IM 0x49     //Exclusive OR (Immediate). Takes 2 cycles.
-#define EOR_ZP 0x45     //Exclusive OR (Zero page). Takes 3 cycles.
-#define EOR_ZPX 0x55    //Exclusive OR (Zero Page X). Takes 4 cycles.
-#define EOR_ABS 0x4D    //Exclusive OR (Absolute). Takes 4 cycles.
-#define EOR_ABSX 0x5D   //Exclusive OR (Absolute X). Takes 4(+1) cycles.
-#define EOR_ABSY 0x59   //Exclusive OR (Absolute Y). Takes 4(+1) cycles.
-#define EOR_INDX 0x41   //Exclusive OR (Indirect X). Takes 6 cycles.
-#define EOR_INDY 0x51   //Exclusive OR (Indirect Y). Takes 5(+1) cycles.
-
-#define ORA_IM 0x09     //Inclusive OR (Immediate). Takes 2 cycles.
-#define ORA_ZP 0x05     //Inclusive OR (Zero page). Takes 3 cycles.
-#define ORA_ZPX 0x15    //Inclusive OR (Zero Page X). Takes 4 cycles.
-#define ORA_ABS 0x0D    //Inclusive OR (Absolute). Takes 4 cycles.
-#define ORA_ABSX 0x1D   //Inclusive OR (Absolute X). Takes 4(+1) cycles.
-#define ORA_ABSY 0x19   //Inclusive OR (Absolute Y). Takes 4(+1) cycles.
-#define ORA_INDX 0x01   //Inclusive OR (Indirect X). Takes 6 cycles.
-#define ORA_INDY 0x11   //Inclusive OR (Indirect Y). Takes 5(+1) cycles.
-
-#define BIT_ZP 0x24     //Bit test (Zero page). Takes 3 cycles.
-#define BIT_ABS 0x2C    //Bit test (Absolute). Takes 4 cycles.
-
-#pragma endregion
-
-#endif // INS_H
\ No newline at end of file
+#endif // INS_H
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef JIT_H
+#define JIT_H
+
+#include "cpu.h"
+#include <stdbool.h>
+
+//Recompiles hot straight-line blocks of loads, stores, transfers, logic
+//and stack pushes/pulls to x86-64 code. Once attached, exec() runs compiled
+//blocks where it can and interprets everything else. Only available on
+//Linux x86-64; elsewhere init_jit() fails and exec() keeps interpreting.
+//Returns 0 on success.
+int init_jit(struct RAM* ram);
+void free_jit(struct RAM* ram);
+//Drops all compiled blocks. Needed after writing to ram->data directly.
+void flush_jit(struct RAM* ram);
+
+//Engine entry points shared by cpu.c and jit.c. exec_jit() also stops
+//once cpu->cycles reaches *deadline, rereading it between blocks.
+int exec_interp(struct CPU* cpu, struct RAM* ram, uint32_t insCount);
+int exec_jit(struct CPU* cpu, struct RAM* ram, uint32_t insCount, const uint64_t* deadline);
+void invalidate_code_at(struct RAM* ram, word addr);
+bool invalidate_jit(struct RAM* ram, word addr);
+
+#endif // JIT_H
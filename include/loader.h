@@ -0,0 +1,40 @@
+#pragma once
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "cpu.h"
+
+typedef enum {
+   IMAGE_AUTO,   //From the file extension: .prg, .hex/.ihx, .s19/.s28/.srec/.mot, else raw.
+   IMAGE_RAW,    //Plain bytes, loaded at the origin passed to open_image().
+   IMAGE_PRG,    //Two-byte little-endian load address, then the bytes.
+   IMAGE_IHEX,   //Intel HEX.
+   IMAGE_SREC    //Motorola S-record.
+} ImageFormat;
+
+//A program image loaded at origin. Raw and .prg files are memory-mapped
+//read-only and used in place; HEX and S-record files are parsed into an
+//owned buffer, with gaps between records zero-filled. Treat as read-only.
+struct Image {
+   const byte* data;
+   uint32_t size;
+   word origin;
+   void* map;        //File mapping, NULL if none.
+   size_t mapSize;
+   byte* owned;      //Heap buffer data points into, NULL if none.
+   byte tail[PAGE_SIZE];   //Copy of a last page that does not fill a whole page.
+};
+
+//Returns 0 on success. origin is only used for raw images.
+int open_image(struct Image* img, const char* path, ImageFormat format, word origin);
+void close_image(struct Image* img);
+//Copies the image into the RAM pages it covers. Returns 0 on success.
+int load_image(struct RAM* ram, const struct Image* img);
+//Maps the image as ROM pages without copying; pages are only read from the
+//file when first touched. The origin must be page-aligned. The image must
+//stay open while mapped. Returns 0 on success.
+int map_image(struct RAM* ram, const struct Image* img);
+//Loads (asRom: maps) the image, then resets the CPU to the vector at $FFFC.
+int load_and_reset(struct CPU* cpu, struct RAM* ram, const struct Image* img, bool asRom);
+
+#endif // LOADER_H
@@ -0,0 +1,125 @@
+#pragma once
+#ifndef OPTABLE_H
+#define OPTABLE_H
+
+#include "cpu.h"
+
+//Operation, addressing mode and base cycles of each opcode, for engines
+//that translate instructions instead of calling the interpreter's handlers.
+//Derived from INS_LIST in ins.h.
+
+typedef enum {
+   OP_NONE = 0,
+   OP_LD,
+   OP_ST,
+   OP_AND,
+   OP_EOR,
+   OP_ORA,
+   OP_TR,
+   OP_TSX,
+   OP_TXS,
+   OP_PHA,
+   OP_PLA,
+   OP_INTERP,   //Known, but only the interpreter implements it.
+   //Kinds of ins.h that only appear in OP_KIND() below. The ones from
+   //OP_JSR on change the flow of control.
+   OP_PHP,
+   OP_PLP,
+   OP_BIT,
+   OP_ADC,
+   OP_SBC,
+   OP_CMP,
+   OP_ASL,
+   OP_LSR,
+   OP_ROL,
+   OP_ROR,
+   OP_INC,
+   OP_DEC,
+   OP_INCR,
+   OP_DECR,
+   OP_CLC,
+   OP_SEC,
+   OP_CLI,
+   OP_SEI,
+   OP_CLV,
+   OP_CLD,
+   OP_SED,
+   OP_NOP,
+   OP_SKP,
+   OP_SLO,
+   OP_RLA,
+   OP_SRE,
+   OP_RRA,
+   OP_DCP,
+   OP_ISC,
+   OP_SAX,
+   OP_LAX,
+   OP_ANC,
+   OP_ALR,
+   OP_ARR,
+   OP_SBX,
+   OP_LAS,
+   OP_JSR,
+   OP_RTS,
+   OP_JMP,
+   OP_BRK,
+   OP_RTI,
+   OP_BPL,
+   OP_BMI,
+   OP_BVC,
+   OP_BVS,
+   OP_BCC,
+   OP_BCS,
+   OP_BNE,
+   OP_BEQ,
+   OP_JAM,
+   OP_TRAP
+} OpKind;
+
+typedef enum {
+   MODE_IMP,
+   MODE_IMM,
+   MODE_ZP,
+   MODE_ZPX,
+   MODE_ZPY,
+   MODE_ABS,
+   MODE_ABSX,
+   MODE_ABSY,
+   MODE_INDX,
+   MODE_INDY,
+   MODE_ACC,
+   MODE_REL,
+   MODE_IND
+} OpMode;
+
+typedef enum {
+   G_A,
+   G_X,
+   G_Y
+} GuestReg;
+
+static const byte modeLen[] = { 0, 1, 1, 1, 1, 2, 2, 2, 1, 1, 0, 1, 2 };
+
+struct OpInfo {
+   byte kind;
+   byte reg;      //Register loaded, stored or written.
+   byte src;      //Source register of transfers.
+   byte mode;
+   byte cycles;   //Without the page-cross cycle of indexed absolute reads.
+};
+
+//Kind of an instruction as the compiling engines see it: control flow ends
+//a block (OP_NONE), and other kinds past OP_INTERP or indirect modes are
+//left to the interpreter, which then counts their cycles itself.
+#define OP_KIND(kind, mode) \
+   (((kind) >= OP_JSR) ? OP_NONE : \
+   ((kind) >= OP_INTERP || MODE_INDX == (mode) || MODE_INDY == (mode)) ? OP_INTERP : (kind))
+
+#define OP_INFO_ENTRY(name, opcode, kind, reg, src, mode, cycles) \
+   [name] = { OP_KIND(OP_##kind, mode), reg, src, mode, (OP_INTERP == OP_KIND(OP_##kind, mode)) ? 0 : cycles },
+static const struct OpInfo opInfo[256] = {
+   INS_LIST(OP_INFO_ENTRY)
+};
+#undef OP_INFO_ENTRY
+
+#endif // OPTABLE_H
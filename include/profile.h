@@ -0,0 +1,69 @@
+#pragma once
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "cpu.h"
+#include "fuse.h"
+#include <stdio.h>
+
+#define PROFILE_MAX_FRAMES 4096   //Distinct call paths. Deeper calls count to their caller.
+
+//One node of the call tree: a subroutine entered by JSR from its parent.
+//Frame 0 is the root, the code that runs outside any JSR.
+struct ProfileFrame {
+   uint64_t cycles;   //Spent in the subroutine itself, not its callees.
+   uint64_t calls;
+   word entry;
+   uint16_t parent;
+};
+
+//Counters kept by exec() while a profiler is attached. Cycles of a JSR
+//count to the caller, cycles of an RTS to the subroutine it leaves.
+struct Profile {
+   uint64_t opCount[256];
+   uint64_t opCycles[256];
+   uint64_t pcCycles[MEM_MAX];   //By the address of the instruction.
+   uint64_t fused[FUSE_COUNT];   //Runs a decode cache would dispatch as one, by FuseKind.
+   uint32_t frame;               //Current call path.
+   uint32_t frameCount;
+   uint32_t lost;                //Calls not in the tree since it is full.
+   struct ProfileFrame frames[PROFILE_MAX_FRAMES];
+   uint16_t children[2 * PROFILE_MAX_FRAMES];   //Hash of (parent, entry) to frame, 0 if empty.
+};
+
+//Attaches a profiler to ram. exec() then runs a separate interpreter loop
+//that updates it; the other engines are untouched. Returns 0 on success.
+int init_profiler(struct RAM* ram);
+void free_profiler(struct RAM* ram);
+//Zeroes all counters and returns to the root frame.
+void reset_profile(struct Profile* prof);
+//Writes the counters as one JSON object with "opcodes", "pcs", "fusion"
+//and "frames" arrays; entries that never ran are left out.
+void write_profile_json(const struct Profile* prof, FILE* file);
+//Writes one "root;sub_XXXX;sub_YYYY cycles" line per call path, the
+//collapsed-stack input of flamegraph tools.
+void write_profile_collapsed(const struct Profile* prof, FILE* file);
+//Dispatches that fused runs save, all runs together.
+uint64_t profile_fused_saving(const struct Profile* prof);
+
+//Enters the subroutine at entry. Called after a JSR.
+void profile_call(struct Profile* prof, word entry);
+
+static inline void profile_ins(struct Profile* prof, word pc, byte opCode, uint64_t cycles) {
+   prof->opCount[opCode]++;
+   prof->opCycles[opCode] += cycles;
+   prof->pcCycles[pc] += cycles;
+}
+
+//Leaves the current subroutine. Called after an RTS; one at the root is
+//ignored.
+static inline void profile_return(struct Profile* prof) {
+   if (0 != prof->lost) {
+      prof->lost--;
+   }
+   else {
+      prof->frame = prof->frames[prof->frame].parent;
+   }
+}
+
+#endif // PROFILE_H
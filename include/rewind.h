@@ -0,0 +1,41 @@
+#pragma once
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "cpu.h"
+
+#define REWIND_MAX_KEYFRAMES 4096   //A minute of 60 Hz frames, and then some.
+
+struct Keyframe {
+   struct Snapshot* snap;
+   uint64_t cycle;
+   size_t size;   //Bytes it holds beyond the keyframe before it.
+};
+
+//Ring of snapshots taken every interval cycles. Snapshots share pages
+//copy-on-write, so each keyframe only adds the pages written since the one
+//before it, and restoring one only touches the pages that differ. Only the
+//CPU and RAM pages are kept; device and scheduler state is the caller's.
+struct Rewind {
+   uint64_t interval;   //Cycles between keyframes.
+   size_t budget;       //Bytes the keyframes may hold. The oldest go first.
+   size_t used;
+   uint32_t head;       //Oldest keyframe.
+   uint32_t count;
+   struct Keyframe frames[REWIND_MAX_KEYFRAMES];
+};
+
+//Returns NULL if out of memory.
+struct Rewind* init_rewind(uint64_t interval, size_t budget);
+void free_rewind(struct Rewind* rw);
+//Takes a keyframe if interval cycles have passed since the newest one.
+//Call it between exec calls, e.g. once per frame. Returns 0, or 1 if a
+//keyframe was due and could not be taken.
+int rewind_record(struct Rewind* rw, struct RAM* ram, const struct CPU* cpu);
+//Restores the newest keyframe at or before cycle, drops the ones after it
+//and runs forward to the first instruction boundary at or past cycle. The
+//replay repeats the original run as long as I/O and devices do. Returns 0,
+//or 1 if no keyframe is that old.
+int rewind_seek(struct Rewind* rw, struct RAM* ram, struct CPU* cpu, uint64_t cycle);
+
+#endif // REWIND_H
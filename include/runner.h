@@ -0,0 +1,42 @@
+#pragma once
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include "cpu.h"
+
+//Why a job stopped.
+typedef enum {
+   RUN_BUDGET,          //Ran its whole budget.
+   RUN_STOPPED          //The CPU stopped; cpu.stop says why.
+} RunStop;
+
+//One emulator run: image is copied to origin in a zeroed RAM, then state
+//runs for up to insBudget instructions, or for cycleBudget cycles if that
+//is not 0.
+struct Job {
+   const byte* image;
+   uint32_t imageSize;
+   word origin;
+   struct CPU state;
+   uint32_t insBudget;
+   int64_t cycleBudget;
+};
+
+struct JobResult {
+   struct CPU cpu;     //Final registers and cycles.
+   RunStop stop;
+   uint32_t worker;    //Index of the worker that ran the job.
+};
+
+struct Runner;
+
+//Creates a pool of workerCount workers, each owning a work-stealing deque
+//and a RAM arena reused by every job it runs. Returns NULL on failure.
+struct Runner* init_runner(uint32_t workerCount);
+void free_runner(struct Runner* runner);
+//Runs all jobs across the pool and blocks until they are done. Every worker
+//writes straight into results[k] for job k, so no lock is taken. Returns 0
+//on success.
+int run_jobs(struct Runner* runner, const struct Job* jobs, struct JobResult* results, uint32_t jobCount);
+
+#endif // RUNNER_H
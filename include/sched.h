@@ -0,0 +1,51 @@
+#pragma once
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "cpu.h"
+#include <stdbool.h>
+
+#define SCHED_MAX_EVENTS 64   //Pending events per RAM.
+
+//Device callback, run at the first instruction boundary where cpu->cycles
+//has reached cycle, the one it was scheduled for. It may schedule further
+//events and drive the interrupt lines below.
+typedef void(*EventFn)(void* ctx, struct RAM* ram, uint64_t cycle);
+
+struct Event {
+   uint64_t cycle;
+   uint32_t seq;   //Scheduling order, so events due together run first come first served.
+   EventFn fn;
+   void* ctx;
+};
+
+//Events of the devices on one bus, in a binary min-heap by cycle, and the
+//interrupt lines they drive. exec_cycles() runs the engines up to limit
+//without looking at either, then runs due events and takes interrupts.
+struct Scheduler {
+   uint64_t limit;   //Where the running engine stops. Lowered when an event or interrupt comes up mid-run.
+   uint32_t irq;     //Asserted IRQ sources, one bit each.
+   bool nmi;         //NMI edge not taken yet.
+   uint32_t seq;
+   uint32_t count;
+   struct Event heap[SCHED_MAX_EVENTS];
+};
+
+//Attaches a scheduler to ram. Only exec_cycles() runs events and takes
+//interrupts; exec() and exec_fast() leave them for the next call of it.
+//Returns 0 on success.
+int init_scheduler(struct RAM* ram);
+void free_scheduler(struct RAM* ram);
+//Returns 0, or 1 if SCHED_MAX_EVENTS events are already pending.
+int schedule_event(struct RAM* ram, uint64_t cycle, EventFn fn, void* ctx);
+//Drops every pending event of fn with ctx.
+void cancel_events(struct RAM* ram, EventFn fn, void* ctx);
+//IRQ is level-triggered: it is taken whenever any source asserts it and I
+//is clear. An NMI is taken once per call, whatever I is.
+void set_irq(struct RAM* ram, uint32_t source, bool asserted);
+void trigger_nmi(struct RAM* ram);
+//Runs the events due at cycle, earliest first, including the ones they
+//schedule. Returns the cycle of the next one, UINT64_MAX if none is left.
+uint64_t run_due_events(struct RAM* ram, uint64_t cycle);
+
+#endif // SCHED_H
@@ -4,14 +4,14 @@
 #include <stdio.h>
 #include "cpu.h"
 
-#define TEST_COUNT 70
+#define TEST_COUNT 97
 #define ASSERT_EQUAL(exp, got, argName) \
    do { \
       if ((exp) != (got)) { \
          printf_s("Assertion failed at line %d, in %s. ", __LINE__, __FILE__); \
-         printf_s("%s - Expected 0x%X but got 0x%X\n", (argName), (exp), (got)); \
+         printf_s("%s - Expected 0x%X but got 0x%X\n", (argName), (unsigned)(exp), (unsigned)(got)); \
       } else { \
-         printf_s("ASSERT\t| %s: E:[0x%X], G:[0x%X] - OK\n", (argName), (exp), (got)); \
+         printf_s("ASSERT\t| %s: E:[0x%X], G:[0x%X] - OK\n", (argName), (unsigned)(exp), (unsigned)(got)); \
       } \
    } while (0)
 
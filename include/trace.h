@@ -0,0 +1,68 @@
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "cpu.h"
+#include <stdatomic.h>
+
+#define TRACE_RING_SIZE (1u << 16)   //Records. Must be a power of two.
+#define TRACE_MAGIC "6502TRC1"        //First 8 bytes of a trace file.
+
+typedef enum {
+   TRACE_INS = 1,   //Instruction about to run.
+   TRACE_READ,
+   TRACE_WRITE
+} TraceKind;
+
+//One 16-byte record. For TRACE_INS addr is the PC, val the opcode and the
+//registers are the state before the instruction; for reads and writes only
+//kind, val and addr are set. cycles is the low half of the running total.
+struct TraceRecord {
+   byte kind;
+   byte val;
+   word addr;
+   byte a;
+   byte x;
+   byte y;
+   byte sp;
+   byte ps;
+   byte pad[3];
+   uint32_t cycles;
+};
+
+//Single-producer single-consumer ring between the CPU and the writer
+//thread. Indices run freely and are masked on access.
+struct TraceRing {
+   _Alignas(64) atomic_uint head;   //Written by the CPU.
+   unsigned cachedTail;             //The CPU's last view of tail.
+   _Alignas(64) atomic_uint tail;   //Written by the writer thread.
+   _Alignas(64) struct TraceRecord records[TRACE_RING_SIZE];
+};
+
+//Starts recording everything exec() runs on ram to the file at path,
+//written by a background thread. Compiled code and fused runs are bypassed
+//while tracing.
+//Needs a build with CPU_TRACE defined; other builds leave the recording
+//out of the interpreter entirely. Returns 0 on success.
+int start_trace(struct RAM* ram, const char* path);
+//Writes out the remaining records and closes the file.
+void stop_trace(struct RAM* ram);
+
+//Wakes the writer thread. Called each time half a ring has been filled.
+void trace_kick(struct TraceRing* ring);
+//Blocks until the writer has made room in a full ring.
+void trace_wait(struct TraceRing* ring);
+
+static inline void trace_push(struct TraceRing* ring, const struct TraceRecord* rec) {
+   unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+   if (TRACE_RING_SIZE == head - ring->cachedTail) {
+      trace_wait(ring);
+   }
+   ring->records[head & (TRACE_RING_SIZE - 1)] = *rec;
+   atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+   if (0 == ((head + 1) & (TRACE_RING_SIZE / 2 - 1))) {
+      trace_kick(ring);
+   }
+}
+
+#endif // TRACE_H
@@ -0,0 +1,549 @@
+#include "../include/cpu.h"
+#include "../include/jit.h"
+#include "../include/profile.h"
+#include "../include/runner.h"
+#include "../include/trace.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_START 0x0200
+#define BENCH_SUB 0x8000
+#define BENCH_DATA 0x3000
+#define BENCH_CALL_DEPTH 16
+#define BENCH_PASSES 200000
+#define BENCH_RUNS 5
+#define BENCH_JOBS 4096
+#define BENCH_WORKERS 8
+#define BENCH_FORKS 20000
+
+#ifdef _WIN32
+#define BENCH_NULL_FILE "NUL"
+#else
+#define BENCH_NULL_FILE "/dev/null"
+#endif // _WIN32
+
+#ifdef CPU_THREADED_DISPATCH
+#define BENCH_ENGINE "threaded"
+#else
+#define BENCH_ENGINE "call"
+#endif // CPU_THREADED_DISPATCH
+
+#ifdef CPU_DIRTY_PAGES
+#define BENCH_DIRTY "+dirty"
+#else
+#define BENCH_DIRTY ""
+#endif // CPU_DIRTY_PAGES
+
+static double now_sec(void) {
+   struct timespec ts;
+   timespec_get(&ts, TIME_UTC);
+   return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static word emit(struct RAM* ram, word addr, const byte* code, size_t len) {
+   for (size_t i = 0; i < len; i++) {
+      ram->data[addr++] = code[i];
+   }
+   return addr;
+}
+
+struct Workload {
+   const char* name;
+   uint32_t (*load)(struct RAM* ram);
+};
+
+//Writes a straight-line mix of loads, stores, transfers, stack and logic
+//instructions. Returns the number of instructions in one pass.
+static uint32_t load_mixed(struct RAM* ram) {
+   static const byte body[] = {
+      LDA_IM, 0x42,
+      STA_ZP, 0x10,
+      LDX_ZP, 0x10,
+      TXA,
+      AND_IM, 0x0F,
+      EOR_ZP, 0x10,
+      ORA_ABS, 0x00, 0x30,
+      TAY,
+      STA_ABSX, 0x00, 0x31,
+      LDY_ZPX, 0x10,
+      PHA,
+      TYA,
+      PLA,
+      BIT_ZP, 0x10,
+      LDA_INDY, 0x20,
+      STA_ZPX, 0x40,
+   };
+   static const uint32_t bodyIns = 16;
+   static const byte call[] = { JSR, BENCH_SUB & 0xFF, BENCH_SUB >> 8 };
+   static const byte sub[] = { TAX, ADC_IM, 0x01, RTS };
+
+   ram->data[0x20] = 0x00;
+   ram->data[0x21] = 0x30;
+
+   word addr = BENCH_START;
+   uint32_t insCount = 0;
+   for (int i = 0; i < 32; i++) {
+      addr = emit(ram, addr, body, sizeof(body));
+      insCount += bodyIns;
+   }
+   emit(ram, addr, call, sizeof(call));
+   emit(ram, BENCH_SUB, sub, sizeof(sub));
+
+   return insCount + 4;
+}
+
+//Status and stack pointer traffic: every instruction reads or writes flags
+//or SP.
+static uint32_t load_flags(struct RAM* ram) {
+   static const byte body[] = {
+      LDA_IM, 0x80,
+      PHP,
+      LDX_IM, 0x00,
+      TSX,
+      PHP,
+      PLP,
+      TXS,
+      PLP,
+      ADC_IM, 0x7F,
+      PHP,
+      PLA,
+      BIT_ZP, 0x10,
+   };
+   static const uint32_t bodyIns = 12;
+
+   ram->data[0x10] = 0xC0;
+
+   word addr = BENCH_START;
+   uint32_t insCount = 0;
+   for (int i = 0; i < 32; i++) {
+      addr = emit(ram, addr, body, sizeof(body));
+      insCount += bodyIns;
+   }
+
+   return insCount;
+}
+
+//Copies 256 bytes one LDA/STA pair at a time: the unrolled inner loop of a
+//memcpy.
+static uint32_t load_copy(struct RAM* ram) {
+   word addr = BENCH_START;
+   for (int i = 0; i < 256; i++) {
+      ram->data[BENCH_DATA + i] = (byte)(i * 5 + 1);
+      word src = (word)(BENCH_DATA + i);
+      word dst = (word)(BENCH_DATA + 0x100 + i);
+      const byte pair[] = { LDA_ABS, src & 0xFF, src >> 8, STA_ABS, dst & 0xFF, dst >> 8 };
+      addr = emit(ram, addr, pair, sizeof(pair));
+   }
+
+   return 512;
+}
+
+//Chains lookups through two 256-byte tables, each result indexing the next.
+static uint32_t load_table(struct RAM* ram) {
+   static const byte ldx[] = { LDX_IM, 0x00 };
+   static const byte body[] = {
+      LDA_ABSX, BENCH_DATA & 0xFF, BENCH_DATA >> 8,
+      TAY,
+      LDA_ABSY, BENCH_DATA & 0xFF, (BENCH_DATA >> 8) + 1,
+      TAX,
+   };
+
+   for (int i = 0; i < 256; i++) {
+      ram->data[BENCH_DATA + i] = (byte)(i * 7 + 3);
+      ram->data[BENCH_DATA + 0x100 + i] = (byte)(i * 13 + 5);
+   }
+
+   word addr = emit(ram, BENCH_START, ldx, sizeof(ldx));
+   for (int i = 0; i < 127; i++) {
+      addr = emit(ram, addr, body, sizeof(body));
+   }
+
+   return 1 + 127 * 4;
+}
+
+//Calls a chain of BENCH_CALL_DEPTH nested subroutines 16 times, so every
+//other instruction is a JSR or an RTS.
+static uint32_t load_calls(struct RAM* ram) {
+   for (int k = 0; k < BENCH_CALL_DEPTH - 1; k++) {
+      word next = (word)(BENCH_SUB + 4 * (k + 1));
+      const byte sub[] = { JSR, next & 0xFF, next >> 8, RTS };
+      emit(ram, (word)(BENCH_SUB + 4 * k), sub, sizeof(sub));
+   }
+   ram->data[BENCH_SUB + 4 * (BENCH_CALL_DEPTH - 1)] = RTS;
+
+   static const byte call[] = { JSR, BENCH_SUB & 0xFF, BENCH_SUB >> 8 };
+   word addr = BENCH_START;
+   for (int i = 0; i < 16; i++) {
+      addr = emit(ram, addr, call, sizeof(call));
+   }
+
+   return 16 * 2 * BENCH_CALL_DEPTH;
+}
+
+//Fills 30 bytes of stack with pushes and takes them back off, eight times.
+static uint32_t load_stack(struct RAM* ram) {
+   static const byte push[] = { PHA, PHP };
+   static const byte pull[] = { PLP, PLA };
+   static const byte sp[] = { TSX, TXS };
+
+   word addr = BENCH_START;
+   for (int i = 0; i < 8; i++) {
+      for (int k = 0; k < 15; k++) {
+         addr = emit(ram, addr, push, sizeof(push));
+      }
+      for (int k = 0; k < 15; k++) {
+         addr = emit(ram, addr, pull, sizeof(pull));
+      }
+      addr = emit(ram, addr, sp, sizeof(sp));
+   }
+
+   return 8 * 62;
+}
+
+//The loop idioms compilers and hand-written code emit most: a 256-byte
+//indexed copy, a DEX/BNE delay and a run of immediate stores.
+static uint32_t load_loops(struct RAM* ram) {
+   static const byte copy[] = {
+      LDX_IM, 0x00,
+      LDA_ABSX, BENCH_DATA & 0xFF, BENCH_DATA >> 8,
+      STA_ABSX, BENCH_DATA & 0xFF, (BENCH_DATA >> 8) + 1,
+      INX,
+      BNE, 0xF7,
+   };
+   static const byte delay[] = {
+      LDX_IM, 0x40,
+      DEX,
+      BNE, 0xFD,
+   };
+
+   for (int i = 0; i < 256; i++) {
+      ram->data[BENCH_DATA + i] = (byte)(i * 3 + 7);
+   }
+
+   word addr = emit(ram, BENCH_START, copy, sizeof(copy));
+   addr = emit(ram, addr, delay, sizeof(delay));
+   for (int i = 0; i < 16; i++) {
+      word dst = (word)(BENCH_DATA + 0x200 + i);
+      const byte store[] = { LDA_IM, (byte)i, STA_ABS, dst & 0xFF, dst >> 8 };
+      addr = emit(ram, addr, store, sizeof(store));
+   }
+
+   return (1 + 256 * 4) + (1 + 64 * 2) + 16 * 2;
+}
+
+//Adds to one 16-bit counter and subtracts from another, 32 times over,
+//with the operands kept as valid BCD so decimal mode gives defined results.
+static uint32_t emit_arith(struct RAM* ram, bool decimal) {
+   static const byte body[] = {
+      CLC,
+      LDA_ZP, 0x10,
+      ADC_ZP, 0x12,
+      STA_ZP, 0x10,
+      LDA_ZP, 0x11,
+      ADC_ZP, 0x13,
+      STA_ZP, 0x11,
+      SEC,
+      LDA_ZP, 0x14,
+      SBC_ZP, 0x12,
+      STA_ZP, 0x14,
+      LDA_ZP, 0x15,
+      SBC_ZP, 0x13,
+      STA_ZP, 0x15,
+   };
+   static const uint32_t bodyIns = 14;
+   static const byte sed[] = { SED };
+   static const byte cld[] = { CLD };
+
+   ram->data[0x12] = 0x37;
+   ram->data[0x13] = 0x02;
+   ram->data[0x14] = 0x99;
+   ram->data[0x15] = 0x99;
+
+   word addr = BENCH_START;
+   uint32_t insCount = 0;
+   if (decimal) {
+      addr = emit(ram, addr, sed, sizeof(sed));
+      insCount++;
+   }
+   for (int i = 0; i < 32; i++) {
+      addr = emit(ram, addr, body, sizeof(body));
+      insCount += bodyIns;
+   }
+   if (decimal) {
+      emit(ram, addr, cld, sizeof(cld));
+      insCount++;
+   }
+
+   return insCount;
+}
+
+static uint32_t load_arith(struct RAM* ram) {
+   return emit_arith(ram, false);
+}
+
+static uint32_t load_bcd(struct RAM* ram) {
+   return emit_arith(ram, true);
+}
+
+typedef enum {
+   RUN_INTERP,
+   RUN_FAST,
+   RUN_CACHE,
+   RUN_JIT,
+   RUN_TRACE,
+   RUN_PROFILE
+} RunMode;
+
+static const char* runModeSuffix[] = { "", "+fast", "+cache", "+jit", "+trace", "+profile" };
+
+static const struct Workload workloads[] = {
+   { "mixed", &load_mixed },
+   { "flags", &load_flags },
+   { "copy", &load_copy },
+   { "table", &load_table },
+   { "calls", &load_calls },
+   { "stack", &load_stack },
+   { "loops", &load_loops },
+   { "arith", &load_arith },
+   { "bcd", &load_bcd },
+};
+
+static bool csvOutput = false;   //Set by --csv: one summary row per workload and mode, nothing else.
+
+//Prints the per-run figures and their mean and standard deviation.
+static void report_runs(const struct Workload* wl, RunMode mode, const double* nsPerIns, const double* mhz) {
+   double nsMean = 0;
+   double mhzMean = 0;
+   for (int run = 0; run < BENCH_RUNS; run++) {
+      nsMean += nsPerIns[run] / BENCH_RUNS;
+      mhzMean += mhz[run] / BENCH_RUNS;
+   }
+   double nsVar = 0;
+   for (int run = 0; run < BENCH_RUNS; run++) {
+      nsVar += (nsPerIns[run] - nsMean) * (nsPerIns[run] - nsMean) / (BENCH_RUNS - 1);
+   }
+   double nsDev = sqrt(nsVar);
+
+   if (csvOutput) {
+      printf_s("%s,%s,%s,%d,%.3f,%.3f,%.2f,%.2f\n", wl->name, ('\0' == runModeSuffix[mode][0]) ? "interp" : runModeSuffix[mode] + 1,
+         BENCH_ENGINE BENCH_DIRTY, BENCH_RUNS, nsMean, nsDev, 1e3 / nsMean, mhzMean);
+      return;
+   }
+   printf_s("%s%s: %.2f ns/ins +- %.2f (%.1f%%), %.2f MIPS, %.2f MHz\n",
+      wl->name, runModeSuffix[mode], nsMean, nsDev, 100 * nsDev / nsMean, 1e3 / nsMean, mhzMean);
+}
+
+static int run_workload(const struct Workload* wl, RunMode mode) {
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   if (NULL == ram) {
+      return 1;
+   }
+   if (RUN_CACHE == mode && 0 != init_decode_cache(ram)) {
+      free_ram(ram);
+      return 1;
+   }
+   if (RUN_JIT == mode && 0 != init_jit(ram)) {
+      if (!csvOutput) {
+         printf_s("%s+jit: JIT not available on this platform\n", wl->name);
+      }
+      free_ram(ram);
+      return 0;
+   }
+   if (RUN_TRACE == mode && 0 != start_trace(ram, BENCH_NULL_FILE)) {
+      if (!csvOutput) {
+         printf_s("%s+trace: tracing needs a CPU_TRACE build\n", wl->name);
+      }
+      free_ram(ram);
+      return 0;
+   }
+   if (RUN_PROFILE == mode && 0 != init_profiler(ram)) {
+      free_ram(ram);
+      return 1;
+   }
+
+   uint32_t insPerPass = wl->load(ram);
+   reset_cpu(&cpu, BENCH_START);
+
+   double nsPerIns[BENCH_RUNS];
+   double mhz[BENCH_RUNS];
+   for (int run = 0; run < BENCH_RUNS; run++) {
+      uint64_t startCycles = cpu.cycles;
+      double start = now_sec();
+      for (uint32_t pass = 0; pass < BENCH_PASSES; pass++) {
+         cpu.pc = BENCH_START;
+         int res = (RUN_FAST == mode) ? exec_fast(&cpu, ram, insPerPass) : exec(&cpu, ram, insPerPass);
+         if (0 != res) {
+            printf_s("CPU stopped at [0x%X]\n", cpu.pc - 1);
+            free_ram(ram);
+            return 1;
+         }
+      }
+      double elapsed = now_sec() - start;
+      double insTotal = (double)insPerPass * BENCH_PASSES;
+      nsPerIns[run] = elapsed * 1e9 / insTotal;
+      mhz[run] = (double)(cpu.cycles - startCycles) / elapsed / 1e6;
+
+      if (!csvOutput) {
+         printf_s("%s%s run %d: %.2f MIPS, %.2f MHz (%.2f ns/ins)\n",
+            wl->name, runModeSuffix[mode], run, insTotal / elapsed / 1e6, mhz[run], nsPerIns[run]);
+      }
+   }
+   report_runs(wl, mode, nsPerIns, mhz);
+
+   //Fused runs only take effect with a decode cache, but the profiler
+   //counts them either way.
+   if (RUN_PROFILE == mode && !csvOutput) {
+      uint64_t insTotal = 0;
+      for (uint32_t op = 0; op < 256; op++) {
+         insTotal += ram->profile->opCount[op];
+      }
+      uint64_t saved = profile_fused_saving(ram->profile);
+      printf_s("%s: fusion saves %.1f%% of dispatches\n", wl->name, 100.0 * (double)saved / (double)insTotal);
+   }
+
+   free_ram(ram);
+   return 0;
+}
+
+//Runs BENCH_JOBS one-pass jobs of the workload through a runner with
+//workerCount workers. Each job includes resetting and loading its RAM.
+static int run_fleet(const struct Workload* wl, uint32_t workerCount) {
+   static struct Job jobs[BENCH_JOBS];
+   static struct JobResult results[BENCH_JOBS];
+   struct RAM* ram = init_ram();
+   struct Runner* runner = init_runner(workerCount);
+   if (NULL == ram || NULL == runner) {
+      free_runner(runner);
+      if (NULL != ram) {
+         free_ram(ram);
+      }
+      return 1;
+   }
+
+   uint32_t insPerPass = wl->load(ram);
+   for (uint32_t k = 0; k < BENCH_JOBS; k++) {
+      jobs[k].image = ram->data;
+      jobs[k].imageSize = MEM_MAX;
+      jobs[k].origin = 0;
+      reset_cpu(&jobs[k].state, BENCH_START);
+      jobs[k].insBudget = insPerPass;
+      jobs[k].cycleBudget = 0;
+   }
+
+   int res = 0;
+   for (int run = 0; run < BENCH_RUNS && 0 == res; run++) {
+      double start = now_sec();
+      res = run_jobs(runner, jobs, results, BENCH_JOBS);
+      double elapsed = now_sec() - start;
+      double insTotal = (double)insPerPass * BENCH_JOBS;
+
+      printf_s("%s fleet x%u run %d: %.0f jobs/s, %.2f MIPS\n",
+         wl->name, workerCount, run, BENCH_JOBS / elapsed, insTotal / elapsed / 1e6);
+   }
+
+   free_runner(runner);
+   free_ram(ram);
+   return res;
+}
+
+//Runs BENCH_FORKS one-pass branches of the workload from one start state,
+//going back either by restoring a snapshot or by copying all of memory.
+static int run_forks(const struct Workload* wl, bool snapshot) {
+   struct CPU cpu;
+   struct CPU start;
+   struct RAM* ram = init_ram();
+   byte* copy = malloc(MEM_MAX);
+   if (NULL == ram || NULL == copy) {
+      free(copy);
+      if (NULL != ram) {
+         free_ram(ram);
+      }
+      return 1;
+   }
+
+   uint32_t insPerPass = wl->load(ram);
+   reset_cpu(&start, BENCH_START);
+   memcpy(copy, ram->data, MEM_MAX);
+   struct Snapshot* snap = snapshot ? take_snapshot(ram, &start) : NULL;
+
+   int res = 0;
+   for (int run = 0; run < BENCH_RUNS && 0 == res; run++) {
+      double start_sec = now_sec();
+      for (uint32_t fork = 0; fork < BENCH_FORKS && 0 == res; fork++) {
+         if (snapshot) {
+            restore_snapshot(ram, &cpu, snap);
+         }
+         else {
+            memcpy(ram->data, copy, MEM_MAX);
+            cpu = start;
+         }
+         res = exec(&cpu, ram, insPerPass);
+      }
+      double elapsed = now_sec() - start_sec;
+
+      printf_s("%s fork %s run %d: %.0f forks/s (%.2f us/fork)\n",
+         wl->name, snapshot ? "snapshot" : "memcpy", run, BENCH_FORKS / elapsed, elapsed * 1e6 / BENCH_FORKS);
+   }
+
+   free_snapshot(snap);
+   free(copy);
+   free_ram(ram);
+   return res;
+}
+
+//Usage: 6502_bench [--csv] [workload...]. Without names every workload runs.
+//--csv prints only "workload,mode,engine,runs,ns_per_ins,ns_stddev,mips,mhz"
+//rows for the single-CPU runs, for tracking across releases.
+int main(int argc, char** argv) {
+   bool selected[sizeof(workloads) / sizeof(workloads[0])] = { false };
+   bool any = false;
+   for (int a = 1; a < argc; a++) {
+      if (0 == strcmp(argv[a], "--csv")) {
+         csvOutput = true;
+         continue;
+      }
+      size_t i = 0;
+      while (i < sizeof(workloads) / sizeof(workloads[0]) && 0 != strcmp(argv[a], workloads[i].name)) {
+         i++;
+      }
+      if (sizeof(workloads) / sizeof(workloads[0]) == i) {
+         printf_s("Unknown workload %s\n", argv[a]);
+         return 1;
+      }
+      selected[i] = true;
+      any = true;
+   }
+
+   if (csvOutput) {
+      printf_s("workload,mode,engine,runs,ns_per_ins,ns_stddev,mips,mhz\n");
+   }
+   else {
+      printf_s("Engine: %s\n", BENCH_ENGINE BENCH_DIRTY);
+   }
+
+   for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+      if (any && !selected[i]) {
+         continue;
+      }
+      for (RunMode mode = RUN_INTERP; mode <= RUN_PROFILE; mode++) {
+         if (0 != run_workload(&workloads[i], mode)) {
+            return 1;
+         }
+      }
+      if (csvOutput) {
+         continue;
+      }
+      if (0 != run_fleet(&workloads[i], 1) || 0 != run_fleet(&workloads[i], BENCH_WORKERS)) {
+         return 1;
+      }
+      if (0 != run_forks(&workloads[i], false) || 0 != run_forks(&workloads[i], true)) {
+         return 1;
+      }
+   }
+
+   return 0;
+}
@@ -1,200 +1,304 @@
 #include "../include/cpu.h"
+#include "../include/fuse.h"
+#include "../include/hooks.h"
+#include "../include/jit.h"
+#include "../include/optable.h"
+#include "../include/profile.h"
+#include "../include/sched.h"
+#include "../include/trace.h"
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+
+#define STACK_PAGE 0x0100
+#define NMI_VECTOR 0xFFFA
+#define IRQ_VECTOR 0xFFFE   //Also taken by BRK.
+
+//Functions the interpreter calls with the registers or on every memory
+//access. The threaded engine keeps the registers in a local that only
+//stays in host registers if nothing it is passed to is called out of line,
+//and the engine is too large for the compiler to inline them on its own.
+#ifdef CPU_THREADED_DISPATCH
+#define CORE_INLINE static inline __attribute__((always_inline))
+#else
+#define CORE_INLINE static inline
+#endif // CPU_THREADED_DISPATCH
+
+typedef void(*InsHandler)(struct CPU* cpu, struct RAM* ram, word op);
+
+//Decoded form of the instruction at one address.
+struct DecodedIns {
+#ifndef CPU_THREADED_DISPATCH
+   InsHandler handler;
+#endif // !CPU_THREADED_DISPATCH
+   word operand;
+   word operand2;       //Operand of the second instruction of a fused run.
+   byte opCode;
+   byte len;            //Length in bytes. 0 if the entry is not decoded.
+   byte cycles;         //Base cycles of the opcode.
+   byte fuse;           //FuseKind of the run starting here. Set in cached entries only.
+};
 
-#define EMPTY_ADDR 0x0
+//Decoded instructions keyed by PC. Pages holding decoded instructions are
+//flagged in ram->codePages; writes to flagged pages drop the entries that
+//could cover the written byte.
+struct DecodeCache {
+   struct DecodedIns ins[MEM_MAX];
+};
 
 #pragma region Memory helpers
 
-static inline byte r_byte_from_addr(word addr, const struct RAM* ram, uint32_t* cycles) {
-   byte val = ram->data[addr];
-   (*cycles)++;
-
-#ifdef _DEBUG
-   printf_s("DEBUG\t| Read [0x%X] from [0x%X]\n", val, addr);
-#endif //_DEBUG
-
-   return val;
-}
+struct IoPage {
+   IoRead read;
+   IoWrite write;
+   void* ctx;
+};
 
-static word r_word_from_addr(word addr, const struct RAM* ram, uint32_t* cycles) {
-   byte loB = r_byte_from_addr(addr, ram, cycles);
-   byte hiB = r_byte_from_addr(addr + 1, ram, cycles);
+//A RAM page shared by a RAM and its snapshots. Freed with the last reference.
+struct SharedPage {
+   uint32_t refs;
+   byte data[PAGE_SIZE];
+};
 
-#ifdef _DEBUG
-   printf_s("DEBUG\t| Read word. loB=[0x%X], hiB=[0x%X]\n", loB, hiB);
-#endif // _DEBUG
+struct Snapshot {
+   struct CPU cpu;
+   struct SharedPage* pages[PAGE_COUNT];   //NULL for ROM and I/O pages.
+};
 
-   return (word)(loB | (hiB << 8));
+static byte read_io(const struct RAM* ram, word addr) {
+   const struct IoPage* io = &ram->io[addr >> 8];
+   return (NULL != io->read) ? io->read(io->ctx, addr) : 0xFF;
 }
 
-static byte r_byte_from_pc(word* pc, const struct RAM* ram, uint32_t* cycles) {
-   byte val = r_byte_from_addr(*pc, ram, cycles);
-   (*pc)++;
-   return val;
+static void write_io(struct RAM* ram, word addr, byte val) {
+   const struct IoPage* io = &ram->io[addr >> 8];
+   if (NULL != io->write) {
+      io->write(io->ctx, addr, val);
+   }
 }
 
-static word r_word_from_pc(word* pc, const struct RAM* ram, uint32_t* cycles) {
-   word val = r_word_from_addr(*pc, ram, cycles);
-   (*pc)+=2;
-   return val;
+//Trace recording is compiled in only with CPU_TRACE; the checks would cost
+//every build about 15% otherwise.
+#ifdef CPU_TRACE
+#define TRACE_ACCESS(ram, kind, addr, val) \
+   do { \
+      if (NULL != (ram)->trace) { \
+         trace_access((ram)->trace, (kind), (addr), (val)); \
+      } \
+   } while (0)
+#define TRACE_INS(ram, cpu, opCode) \
+   do { \
+      if (NULL != (ram)->trace) { \
+         trace_ins((ram)->trace, (cpu), (opCode)); \
+      } \
+   } while (0)
+#else
+#define TRACE_ACCESS(ram, kind, addr, val) ((void)0)
+#define TRACE_INS(ram, cpu, opCode) ((void)0)
+#endif // CPU_TRACE
+
+CORE_INLINE void trace_access(struct TraceRing* ring, TraceKind kind, word addr, byte val) {
+   struct TraceRecord rec = { .kind = (byte)kind, .val = val, .addr = addr };
+   trace_push(ring, &rec);
 }
 
-static inline void w_byte_to_mem(byte val, word addr, struct RAM* ram, uint32_t* cycles) {
-   ram->data[addr] = val;
-   (*cycles)++;
-#ifdef _DEBUG
-   printf_s("DEBUG\t| Wrote [0x%X] to [0x%X]\n", val, addr);
-#endif // _DEBUG
+//Events seen by the trace recorder and the compile-time hooks in hooks.h.
+//All of them compile to nothing in release builds.
+CORE_INLINE void on_read(const struct RAM* ram, word addr, byte val) {
+   TRACE_ACCESS(ram, TRACE_READ, addr, val);
+   CPU_ON_READ(ram, addr, val);
 }
 
-static inline void push_byte_to_stack(struct RAM* ram, word* sp, byte val, uint32_t* cycles) {
-   (*sp)--;
-   ram->data[*sp] = val;
-   (*cycles)++;
-#ifdef _DEBUG
-   printf_s("DEBUG\t| Pushed [0x%X] to the stack. Current SP: [0x%X]\n", val, *sp);
-#endif // _DEBUG
+CORE_INLINE void on_write(const struct RAM* ram, word addr, byte val) {
+   TRACE_ACCESS(ram, TRACE_WRITE, addr, val);
+   CPU_ON_WRITE(ram, addr, val);
 }
 
-static inline byte pop_byte_from_stack(const struct RAM* ram, word* sp, uint32_t* cycles) {
-   byte val = ram->data[*sp];
-   (*sp)++;
-   (*cycles)++;
-#ifdef _DEBUG
-   printf_s("DEBUG\t| Popped [0x%X] from the stack. Current SP: [0x%X]\n", val, *sp);
-#endif //_DEBUG
-   return val;
+CORE_INLINE void on_push(const struct RAM* ram, byte sp, byte val) {
+   TRACE_ACCESS(ram, TRACE_WRITE, STACK_PAGE | sp, val);
+   CPU_ON_PUSH(ram, sp, val);
 }
 
-static void push_word_to_stack(struct RAM* ram, word* sp, word val, uint32_t* cycles) {
-   push_byte_to_stack(ram, sp, (val >> 8), cycles);
-   push_byte_to_stack(ram, sp, (val & 0xFF), cycles);
+CORE_INLINE void on_pop(const struct RAM* ram, byte sp, byte val) {
+   TRACE_ACCESS(ram, TRACE_READ, STACK_PAGE | sp, val);
+   CPU_ON_POP(ram, sp, val);
 }
 
-static word pop_word_from_stack(const struct RAM* ram, word* sp, uint32_t* cycles) {
-   byte lB = pop_byte_from_stack(ram, sp, cycles);
-   byte hB = pop_byte_from_stack(ram, sp, cycles);
-   (*cycles)++;
-   return (word)((hB << 8) | lB);
+CORE_INLINE void on_flags(const struct CPU* cpu) {
+   CPU_ON_FLAGS(cpu);
 }
 
-#pragma endregion
+CORE_INLINE byte mem_read(const struct RAM* ram, word addr) {
+   const byte* page = ram->readPages[addr >> 8];
+   if (NULL != page) {
+      return page[addr & 0xFF];
+   }
+   return read_io(ram, addr);
+}
 
-#pragma region Addressing mode helpers
+//Slow path of invalidate_code(), for writes to pages flagged as code.
+//A decoded entry covers at most FUSE_SPAN_MAX bytes, so a write to addr can
+//only change the entries decoded at addr and the ones just before it.
+void invalidate_code_at(struct RAM* ram, word addr) {
+   struct DecodeCache* cache = ram->cache;
+   if (NULL != cache) {
+      for (uint32_t k = 0; k < FUSE_SPAN_MAX; k++) {
+         cache->ins[(word)(addr - k)].len = 0;
+      }
+   }
 
-typedef enum {
-   NONE,
-   X,
-   Y
-} AddrModeReg;
+   if (NULL != ram->jit) {
+      invalidate_jit(ram, addr);
+   }
+}
 
-static byte zp_addr(struct CPU* cpu, const struct RAM* ram, AddrModeReg reg) {
-   byte zpAddr = r_byte_from_pc(&cpu->pc, ram, &cpu->cycles);
-   byte regVal;
+CORE_INLINE void invalidate_code(struct RAM* ram, word addr) {
+   if (0 != (ram->codePages[addr >> 11] & (1 << ((addr >> 8) & 7)))) {
+      invalidate_code_at(ram, addr);
+   }
+}
 
-   switch (reg)
-   {
-   case X: regVal = cpu->x; break;
-   case Y: regVal = cpu->y; break;
-   default: return zpAddr;
+static void release_shared(struct SharedPage* page) {
+   if (NULL != page && 0 == --page->refs) {
+      free(page);
    }
+}
 
-   zpAddr += regVal;
-   cpu->cycles++;
+static void release_page(struct RAM* ram, byte p) {
+   release_shared(ram->shared[p]);
+   ram->shared[p] = NULL;
+}
 
-   return zpAddr;
+static bool is_flat(const struct RAM* ram) {
+   for (uint32_t p = 0; p < PAGE_COUNT; p++) {
+      byte* own = &ram->data[p * PAGE_SIZE];
+      if (own != ram->readPages[p] || own != ram->writePages[p]) {
+         return false;
+      }
+   }
+   return true;
 }
 
-static word abs_addr(struct CPU* cpu, const struct RAM* ram, AddrModeReg reg, bool canPageCross) {
-   word absAddr = r_word_from_pc(&cpu->pc, ram, &cpu->cycles);
-   byte regVal;
+//Pages a snapshot can capture: host memory read and written at the same
+//place, or such a page already write-protected by a snapshot.
+static bool is_ram_page(const struct RAM* ram, byte p) {
+   return NULL != ram->shared[p] || (NULL != ram->readPages[p] && ram->readPages[p] == ram->writePages[p]);
+}
 
-   switch (reg)
-   {
-   case X: regVal = cpu->x; break;
-   case Y: regVal = cpu->y; break;
-   default: return absAddr;
+//Writes to pages without a write pointer: snapshotted pages and I/O. The
+//snapshots keep their own copy, so a snapshotted page only has to drop it
+//and take its write pointer back.
+static void write_slow(struct RAM* ram, word addr, byte val) {
+   byte p = addr >> 8;
+   if (NULL == ram->shared[p]) {
+      write_io(ram, addr, val);
+      return;
    }
 
-   word absAddrReg = absAddr + regVal;
-   if (canPageCross) {
-      cpu->cycles += ((absAddr & 0xFF00) != (absAddrReg & 0xFF00)) ? 1 : 0;
-   }
-   else {
-      cpu->cycles++;
+   release_page(ram, p);
+   ram->writePages[p] = ram->readPages[p];
+   ram->flat = is_flat(ram);
+   ram->writePages[p][addr & 0xFF] = val;
+   mark_dirty(ram, addr);
+   invalidate_code(ram, addr);
+}
+
+CORE_INLINE void mem_write(struct RAM* ram, word addr, byte val) {
+   byte* page = ram->writePages[addr >> 8];
+   if (NULL != page) {
+      page[addr & 0xFF] = val;
+      mark_dirty(ram, addr);
+      invalidate_code(ram, addr);
+      return;
    }
+   write_slow(ram, addr, val);
+}
 
-   return absAddrReg;
+//Bus accesses of the instruction handlers. They count no cycles: the loop
+//adds the base cycles of each opcode in one go.
+CORE_INLINE byte r_byte_from_addr(word addr, const struct RAM* ram) {
+   byte val = mem_read(ram, addr);
+   on_read(ram, addr, val);
+   return val;
 }
 
-static word ind_addr(struct CPU* cpu, const struct RAM* ram, AddrModeReg reg, bool canPageCross) {
-   byte zpAddr = r_byte_from_pc(&cpu->pc, ram, &cpu->cycles);
-   word baseAddr;
+CORE_INLINE word r_word_from_addr(word addr, const struct RAM* ram) {
+   byte loB = r_byte_from_addr(addr, ram);
+   byte hiB = r_byte_from_addr(addr + 1, ram);
+   return (word)(loB | (hiB << 8));
+}
 
-   switch (reg)
-   {
-   case X: {
-      zpAddr += cpu->x;
-      cpu->cycles++;
-
-      baseAddr = r_word_from_addr(zpAddr, ram, &cpu->cycles);
-      return baseAddr;
-   }
-   case Y: {
-      baseAddr = r_word_from_addr(zpAddr, ram, &cpu->cycles);
-      word addrY = baseAddr + cpu->y;
-      if (canPageCross) {
-         cpu->cycles += ((baseAddr & 0xFF00) != (addrY & 0xFF00)) ? 1 : 0;
-      }
-      else {
-         cpu->cycles++;
-      }
+CORE_INLINE void w_byte_to_mem(byte val, word addr, struct RAM* ram) {
+   mem_write(ram, addr, val);
+   on_write(ram, addr, val);
+}
 
-      return addrY;
-   }
-   default: return 0x0;
-   }
+CORE_INLINE void push_byte_to_stack(struct RAM* ram, byte* sp, byte val) {
+   (*sp)--;
+   mem_write(ram, STACK_PAGE | *sp, val);
+   on_push(ram, *sp, val);
+}
+
+CORE_INLINE byte pop_byte_from_stack(const struct RAM* ram, byte* sp) {
+   byte val = mem_read(ram, STACK_PAGE | *sp);
+   on_pop(ram, *sp, val);
+   (*sp)++;
+   return val;
+}
+
+CORE_INLINE void push_word_to_stack(struct RAM* ram, byte* sp, word val) {
+   push_byte_to_stack(ram, sp, (val >> 8));
+   push_byte_to_stack(ram, sp, (val & 0xFF));
+}
+
+CORE_INLINE word pop_word_from_stack(const struct RAM* ram, byte* sp) {
+   byte lB = pop_byte_from_stack(ram, sp);
+   byte hB = pop_byte_from_stack(ram, sp);
+   return (word)((hB << 8) | lB);
 }
 
 #pragma endregion
 
 #pragma region Flag helpers
 
-static void update_ps(struct CPU* cpu) {
+CORE_INLINE byte pack_ps(const struct CPU* cpu) {
    byte ps = 0x0;
 
-   ps |= (cpu->n << 7);
+   ps |= ((cpu->nRes & 0x80) != 0) << 7;
    ps |= (cpu->v << 6);
    ps |= (cpu->b << 4);
    ps |= (cpu->d << 3);
    ps |= (cpu->i << 2);
-   ps |= (cpu->z << 1);
+   ps |= (cpu->zRes == 0) << 1;
    ps |= cpu->c;
 
-   cpu->ps = ps;
+   return ps;
+}
 
-#ifdef _DEBUG
-   printf_s("DEBUG\t| Set Processor Status: PS: [0x%X]\n", ps);
-#endif // _DEBUG
+CORE_INLINE void unpack_ps(struct CPU* cpu, byte ps) {
+   cpu->c = (ps & FLAG_C) != 0;
+   cpu->i = (ps & FLAG_I) != 0;
+   cpu->d = (ps & FLAG_D) != 0;
+   cpu->b = (ps & FLAG_B) != 0;
+   cpu->v = (ps & FLAG_V) != 0;
+   cpu->zRes = (ps & FLAG_Z) ? 0x00 : 0x01;
+   cpu->nRes = ps & FLAG_N;
+   on_flags(cpu);
 }
 
-static inline void set_zn_flags(struct CPU* cpu, byte reg) {
-   cpu->z = (reg == 0);
-   cpu->n = (reg & 0x80) > 0;
-#ifdef _DEBUG
-   printf_s("DEBUG\t| Set Flags: Z: [0x%X], N: [0x%X]\n", cpu->z, cpu->n);
-#endif // _DEBUG
-   update_ps(cpu);
+//Z and N are not computed on write. Only the result is recorded and the
+//flags are derived by pack_ps() and get_flag() when something reads them.
+CORE_INLINE void set_zn_flags(struct CPU* cpu, byte reg) {
+   cpu->zRes = reg;
+   cpu->nRes = reg;
+   on_flags(cpu);
 }
 
-static inline void set_cv_flags(struct CPU* cpu, word sum) {
+//V is set when both addends have the same sign and the sum does not.
+CORE_INLINE void set_cv_flags(struct CPU* cpu, byte lhs, byte rhs, word sum) {
    cpu->c = sum > 0xFF;
-   cpu->v = (sum & 0x100) != 0;
-#ifdef _DEBUG
-   printf_s("DEBUG\t| Set Flags: C: [0x%X], V: [0x%X]\n", cpu->c, cpu->v);
-#endif // _DEBUG
-   update_ps(cpu);
+   cpu->v = ((lhs ^ sum) & (rhs ^ sum) & 0x80) != 0;
+   on_flags(cpu);
 }
 
 #pragma endregion
@@ -207,19 +311,21 @@ typedef enum {
    ORA
 } LogIns;
 
-static void ld_ins(struct CPU* cpu, const struct RAM* ram, byte* reg, word valAddr) {
-   byte val = EMPTY_ADDR == valAddr 
-      ? r_byte_from_pc(&cpu->pc, ram, &cpu->cycles) 
-      : r_byte_from_addr(valAddr, ram, &cpu->cycles);
+//CLI, PLP and RTI can clear I while a device holds IRQ. The running engine
+//then stops after the instruction so exec_scheduled() takes the IRQ; until
+//then, a masked IRQ costs nothing.
+CORE_INLINE void check_irq_unmasked(const struct CPU* cpu, struct RAM* ram) {
+   if (0 == cpu->i && NULL != ram->sched && 0 != ram->sched->irq) {
+      ram->sched->limit = 0;
+   }
+}
+
+CORE_INLINE void ld_ins(struct CPU* cpu, byte* reg, byte val) {
    (*reg) = val;
    set_zn_flags(cpu, *reg);
 }
 
-static void logic_ins(struct CPU* cpu, const struct RAM* ram, word valAddr, LogIns ins) {
-   byte val = EMPTY_ADDR == valAddr
-      ? r_byte_from_pc(&cpu->pc, ram, &cpu->cycles)
-      : r_byte_from_addr(valAddr, ram, &cpu->cycles);
-   
+CORE_INLINE void logic_ins(struct CPU* cpu, byte val, LogIns ins) {
    switch (ins)
    {
    case AND: 
@@ -236,524 +342,739 @@ static void logic_ins(struct CPU* cpu, const struct RAM* ram, word valAddr, LogI
    set_zn_flags(cpu, cpu->a);
 }
 
-#pragma endregion
+//Decimal mode works on one nibble at a time, as the NMOS 6502 does: the
+//nibbles are added (subtracted) with the carry (borrow) of the lower one,
+//and 6 is added (subtracted) when the result leaves 0-9. bcdAdd and bcdSub
+//hold every such step, indexed by BCD_INDEX(). An entry has the adjusted
+//nibble in bits 0-3 and its carry (borrow) in bit 4. bcdAdd also has bit 3
+//of the unadjusted sum in bit 7, which is where N and V are taken from.
+#define BCD_INDEX(x, y, carry) (((x) << 5) | ((y) << 1) | (carry))
+#define BCD_ADD(x, y, carry) (byte)( \
+   ((((x) + (y) + (carry)) + ((((x) + (y) + (carry)) > 9) ? 6 : 0)) & 0x0F) | \
+   ((((x) + (y) + (carry)) > 9) << 4) | \
+   ((((x) + (y) + (carry)) & 0x08) << 4))
+#define BCD_SUB(x, y, borrow) (byte)( \
+   ((32 + (x) - (y) - (borrow) - ((((x) - (y) - (borrow)) < 0) ? 6 : 0)) & 0x0F) | \
+   ((((x) - (y) - (borrow)) < 0) << 4))
+
+#define BCD_Y(op, x, y) op(x, y, 0), op(x, y, 1),
+#define BCD_X(op, x) \
+   BCD_Y(op, x, 0x0) BCD_Y(op, x, 0x1) BCD_Y(op, x, 0x2) BCD_Y(op, x, 0x3) \
+   BCD_Y(op, x, 0x4) BCD_Y(op, x, 0x5) BCD_Y(op, x, 0x6) BCD_Y(op, x, 0x7) \
+   BCD_Y(op, x, 0x8) BCD_Y(op, x, 0x9) BCD_Y(op, x, 0xA) BCD_Y(op, x, 0xB) \
+   BCD_Y(op, x, 0xC) BCD_Y(op, x, 0xD) BCD_Y(op, x, 0xE) BCD_Y(op, x, 0xF)
+#define BCD_TABLE(op) \
+   BCD_X(op, 0x0) BCD_X(op, 0x1) BCD_X(op, 0x2) BCD_X(op, 0x3) \
+   BCD_X(op, 0x4) BCD_X(op, 0x5) BCD_X(op, 0x6) BCD_X(op, 0x7) \
+   BCD_X(op, 0x8) BCD_X(op, 0x9) BCD_X(op, 0xA) BCD_X(op, 0xB) \
+   BCD_X(op, 0xC) BCD_X(op, 0xD) BCD_X(op, 0xE) BCD_X(op, 0xF)
+
+static const byte bcdAdd[512] = { BCD_TABLE(BCD_ADD) };
+static const byte bcdSub[512] = { BCD_TABLE(BCD_SUB) };
+
+#undef BCD_TABLE
+#undef BCD_X
+#undef BCD_Y
+#undef BCD_SUB
+#undef BCD_ADD
+
+//Binary A + val + C. Sets all four flags and returns the sum without
+//storing it.
+CORE_INLINE byte add_binary(struct CPU* cpu, byte val) {
+   word sum = cpu->a + val + cpu->c;
+   set_zn_flags(cpu, (byte)sum);
+   set_cv_flags(cpu, cpu->a, val, sum);
+   return (byte)sum;
+}
 
-#pragma region Instruction handlers
+//In decimal mode Z still comes from the binary sum, and N and V from the
+//high nibble before it is adjusted.
+CORE_INLINE void adc_ins(struct CPU* cpu, byte val) {
+   if (0 == cpu->d) {
+      cpu->a = add_binary(cpu, val);
+      return;
+   }
 
-static void jsr(struct CPU* cpu, struct RAM* ram) {
-   word addr = r_word_from_pc(&cpu->pc, ram, &cpu->cycles);
-   push_word_to_stack(ram, &cpu->sp, cpu->pc - 1, &cpu->cycles);
+   byte lo = bcdAdd[BCD_INDEX(cpu->a & 0x0F, val & 0x0F, cpu->c)];
+   byte hi = bcdAdd[BCD_INDEX(cpu->a >> 4, val >> 4, (lo >> 4) & 0x01)];
+   cpu->zRes = (byte)(cpu->a + val + cpu->c);
+   cpu->nRes = hi & 0x80;
+   cpu->v = (~(cpu->a ^ val) & (cpu->a ^ hi) & 0x80) != 0;
+   cpu->c = (hi >> 4) & 0x01;
+   cpu->a = (byte)((hi << 4) | (lo & 0x0F));
+   on_flags(cpu);
+}
+
+//SBC is ADC of the complement. In decimal mode only A differs; the flags
+//are those of the binary result.
+CORE_INLINE void sbc_ins(struct CPU* cpu, byte val) {
+   if (0 == cpu->d) {
+      cpu->a = add_binary(cpu, (byte)~val);
+      return;
+   }
 
-   cpu->pc = addr;
-   cpu->cycles++;
+   byte lo = bcdSub[BCD_INDEX(cpu->a & 0x0F, val & 0x0F, !cpu->c)];
+   byte hi = bcdSub[BCD_INDEX(cpu->a >> 4, val >> 4, (lo >> 4) & 0x01)];
+   add_binary(cpu, (byte)~val);
+   cpu->a = (byte)((hi << 4) | (lo & 0x0F));
 }
 
-static void rts(struct CPU* cpu, const struct RAM* ram) {
-   word addr = pop_word_from_stack(ram, &cpu->sp, &cpu->cycles);
-   cpu->pc = addr + 1;
-   cpu->cycles += 2;
-}
+#undef BCD_INDEX
 
-static void lda_imm(struct CPU* cpu, const struct RAM* ram) {
-   ld_ins(cpu, ram, &cpu->a, EMPTY_ADDR);
+CORE_INLINE void cmp_ins(struct CPU* cpu, byte reg, byte val) {
+   cpu->c = reg >= val;
+   set_zn_flags(cpu, (byte)(reg - val));
 }
 
-static void lda_zp(struct CPU* cpu, const struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, NONE);
-   ld_ins(cpu, ram, &cpu->a, addr);
+//ANC: AND, then C is copied from N.
+CORE_INLINE void anc_ins(struct CPU* cpu, byte val) {
+   logic_ins(cpu, val, AND);
+   cpu->c = cpu->a >> 7;
 }
 
-static void lda_zp_X(struct CPU* cpu, const struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, X);
-   ld_ins(cpu, ram, &cpu->a, addr);
+//ALR: AND, then LSR A.
+CORE_INLINE void alr_ins(struct CPU* cpu, byte val) {
+   byte res = cpu->a & val;
+   cpu->c = res & 0x01;
+   cpu->a = res >> 1;
+   set_zn_flags(cpu, cpu->a);
 }
 
-static void lda_abs(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, NONE, false);
-   ld_ins(cpu, ram, &cpu->a, addr);
-}
+//ARR: AND, then ROR A, with C and V taken from bits 6 and 5 of the result.
+//In decimal mode N, Z and V come from the binary result and the nibbles
+//are then adjusted as by ADC.
+CORE_INLINE void arr_ins(struct CPU* cpu, byte val) {
+   byte res = cpu->a & val;
+   cpu->a = (byte)((res >> 1) | (cpu->c << 7));
+   set_zn_flags(cpu, cpu->a);
+   cpu->v = ((cpu->a ^ (cpu->a << 1)) & 0x40) != 0;
 
-static void lda_abs_X(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, X, true);
-   ld_ins(cpu, ram, &cpu->a, addr);
+   if (0 == cpu->d) {
+      cpu->c = (cpu->a >> 6) & 0x01;
+      return;
+   }
+   if ((res & 0x0F) + (res & 0x01) > 0x05) {
+      cpu->a = (byte)((cpu->a & 0xF0) | ((cpu->a + 0x06) & 0x0F));
+   }
+   cpu->c = (res & 0xF0) + (res & 0x10) > 0x50;
+   if (cpu->c) {
+      cpu->a += 0x60;
+   }
 }
 
-static void lda_abs_Y(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, Y, true);
-   ld_ins(cpu, ram, &cpu->a, addr);
+//SBX: X = (A & X) - operand, with C and the flags of a compare.
+CORE_INLINE void sbx_ins(struct CPU* cpu, byte val) {
+   byte ax = cpu->a & cpu->x;
+   cpu->x = (byte)(ax - val);
+   cpu->c = ax >= val;
+   set_zn_flags(cpu, cpu->x);
 }
 
-static void lda_ind_X(struct CPU* cpu, const struct RAM* ram) {
-   word addr = ind_addr(cpu, ram, X, false);   
-   ld_ins(cpu, ram, &cpu->a, addr);
+//LAS: A, X and SP are all set to the operand AND SP.
+CORE_INLINE void las_ins(struct CPU* cpu, byte val) {
+   cpu->sp &= val;
+   cpu->x = cpu->sp;
+   ld_ins(cpu, &cpu->a, cpu->sp);
 }
 
-static void lda_ind_Y(struct CPU* cpu, const struct RAM* ram) {
-   word addr = ind_addr(cpu, ram, Y, true);
-   ld_ins(cpu, ram, &cpu->a, addr);
-}
+//Read-modify-write operations. They return the new value and update C
+//where the instruction does; Z and N are left to the caller.
+typedef byte(*ModifyOp)(struct CPU* cpu, byte val);
 
-static void ldx_imm(struct CPU* cpu, const struct RAM* ram) {
-   ld_ins(cpu, ram, &cpu->x, EMPTY_ADDR);
+CORE_INLINE byte asl_op(struct CPU* cpu, byte val) {
+   cpu->c = val >> 7;
+   return (byte)(val << 1);
 }
 
-static void ldx_zp(struct CPU* cpu, const struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, NONE);
-   ld_ins(cpu, ram, &cpu->x, addr);
+CORE_INLINE byte lsr_op(struct CPU* cpu, byte val) {
+   cpu->c = val & 0x01;
+   return val >> 1;
 }
 
-static void ldx_zp_y(struct CPU* cpu, const struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, Y);
-   ld_ins(cpu, ram, &cpu->x, addr);
+CORE_INLINE byte rol_op(struct CPU* cpu, byte val) {
+   byte res = (byte)((val << 1) | cpu->c);
+   cpu->c = val >> 7;
+   return res;
 }
 
-static void ldx_abs(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, NONE, false);
-   ld_ins(cpu, ram, &cpu->x, addr);
+CORE_INLINE byte ror_op(struct CPU* cpu, byte val) {
+   byte res = (byte)((val >> 1) | (cpu->c << 7));
+   cpu->c = val & 0x01;
+   return res;
 }
 
-static void ldx_abs_y(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, Y, true);
-   ld_ins(cpu, ram, &cpu->x, addr);
+CORE_INLINE byte inc_op(struct CPU* cpu, byte val) {
+   (void)cpu;
+   return val + 1;
 }
 
-static void ldy_imm(struct CPU* cpu, const struct RAM* ram) {
-   ld_ins(cpu, ram, &cpu->y, EMPTY_ADDR);
+CORE_INLINE byte dec_op(struct CPU* cpu, byte val) {
+   (void)cpu;
+   return val - 1;
 }
 
-static void ldy_zp(struct CPU* cpu, const struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, NONE);
-   ld_ins(cpu, ram, &cpu->y, addr);
-}
+#pragma endregion
 
-static void ldy_zp_x(struct CPU* cpu, const struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, X);
-   ld_ins(cpu, ram, &cpu->y, addr);
-}
+#pragma region Instruction handlers
 
-static void ldy_abs(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, NONE, false);
-   ld_ins(cpu, ram, &cpu->y, addr);
-}
+//The handlers and the helpers that count cycles are generated twice from
+//cpu_core.h: cycle-accurate, and functional with a _fast suffix.
+#define CORE_CYCLES 1
+#define CORE_SUFFIX
+#include "cpu_core.h"
 
-static void ldy_abs_x(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, X, true);
-   ld_ins(cpu, ram, &cpu->y, addr);
-}
+#define CORE_CYCLES 0
+#define CORE_SUFFIX _fast
+#include "cpu_core.h"
 
-static void sta_zp(struct CPU* cpu, struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, NONE);
-   w_byte_to_mem(cpu->a, addr, ram, &cpu->cycles);
-}
+#pragma endregion
 
-static void sta_zp_x(struct CPU* cpu, struct RAM* ram) {
-   word addr = zp_addr(cpu, ram, X);
-   w_byte_to_mem(cpu->a, addr, ram, &cpu->cycles);
-}
+//Operand bytes of each addressing mode, as constants for the steps below.
+#define MODE_LEN(mode) MODE_LEN_##mode
+#define MODE_LEN_MODE_IMP 0
+#define MODE_LEN_MODE_IMM 1
+#define MODE_LEN_MODE_ZP 1
+#define MODE_LEN_MODE_ZPX 1
+#define MODE_LEN_MODE_ZPY 1
+#define MODE_LEN_MODE_ABS 2
+#define MODE_LEN_MODE_ABSX 2
+#define MODE_LEN_MODE_ABSY 2
+#define MODE_LEN_MODE_INDX 1
+#define MODE_LEN_MODE_INDY 1
+#define MODE_LEN_MODE_ACC 0
+#define MODE_LEN_MODE_REL 1
+#define MODE_LEN_MODE_IND 2
+
+//Each handler is wrapped in a step that advances PC by the constant length
+//of its opcode. Loading the length from the decoded entry instead would put
+//a memory load on the PC dependency chain of every instruction. Threaded
+//builds only use the steps in the profiling loop.
+#define INS_STEP(name, opcode, kind, reg, src, mode, cycles) \
+   static void step_##name(struct CPU* cpu, struct RAM* ram, word operand) { \
+      cpu->pc += 1 + MODE_LEN(mode); \
+      ins_##name(cpu, ram, operand); \
+   }
+INS_LIST(INS_STEP)
+#undef INS_STEP
 
-static void sta_abs(struct CPU* cpu, struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, NONE, false);
-   w_byte_to_mem(cpu->a, addr, ram, &cpu->cycles);
-}
+//Instruction map.
+#define INS_TABLE_ENTRY(name, opcode, kind, reg, src, mode, cycles) [name] = &step_##name,
+InsHandler insTable[256] = {
+   INS_LIST(INS_TABLE_ENTRY)
+};
+#undef INS_TABLE_ENTRY
+
+#ifndef CPU_THREADED_DISPATCH
+//Instruction map of the functional handlers. Decoded entries hold the
+//cycle-accurate handler, so the functional loop looks opcodes up here.
+#define INS_STEP(name, opcode, kind, reg, src, mode, cycles) \
+   static void step_##name##_fast(struct CPU* cpu, struct RAM* ram, word operand) { \
+      cpu->pc += 1 + MODE_LEN(mode); \
+      ins_##name##_fast(cpu, ram, operand); \
+   }
+INS_LIST(INS_STEP)
+#undef INS_STEP
 
-static void sta_abs_x(struct CPU* cpu, struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, X, false);
-   w_byte_to_mem(cpu->a, addr, ram, &cpu->cycles);
-}
+#define INS_TABLE_ENTRY(name, opcode, kind, reg, src, mode, cycles) [name] = &step_##name##_fast,
+static const InsHandler insTableFast[256] = {
+   INS_LIST(INS_TABLE_ENTRY)
+};
+#undef INS_TABLE_ENTRY
+#endif // !CPU_THREADED_DISPATCH
 
-static void sta_abs_y(struct CPU* cpu, struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, Y, false);
-   w_byte_to_mem(cpu->a, addr, ram, &cpu->cycles);
-}
+#define INS_COUNT_ENTRY(name, opcode, kind, reg, src, mode, cycles) + 1
+_Static_assert(256 == 0 INS_LIST(INS_COUNT_ENTRY), "INS_LIST must cover every opcode");
+#undef INS_COUNT_ENTRY
 
-static void sta_ind_x(struct CPU* cpu, struct RAM* ram) {
-   word addr = ind_addr(cpu, ram, X, false);
-   w_byte_to_mem(cpu->a, addr, ram, &cpu->cycles);
-}
+//Instruction length in bytes.
+#define INS_LEN_ENTRY(name, opcode, kind, reg, src, mode, cycles) [name] = 1 + MODE_LEN(mode),
+static const byte insLen[256] = {
+   INS_LIST(INS_LEN_ENTRY)
+};
+#undef INS_LEN_ENTRY
 
-static void sta_ind_y(struct CPU* cpu, struct RAM* ram) {
-   word addr = ind_addr(cpu, ram, Y, false);
-   w_byte_to_mem(cpu->a, addr, ram, &cpu->cycles);
-}
+//Base cycles, added once per instruction. The handlers only add the
+//page-crossing cycle of indexed reads and the cycles of taken branches.
+#define INS_CYCLES_ENTRY(name, opcode, kind, reg, src, mode, cycles) [name] = cycles,
+static const byte insCycles[256] = {
+   INS_LIST(INS_CYCLES_ENTRY)
+};
+#undef INS_CYCLES_ENTRY
+
+#pragma region Fused runs
+
+//Cycles of the instructions before the last one of a fused run, at most.
+//Runs are only started this far from a cycle deadline, so they end where
+//separate dispatches would.
+#define FUSE_CYCLES_MAX 16
+
+typedef uint32_t(*FusedHandler)(struct CPU* cpu, struct RAM* ram, const struct DecodedIns* ins);
+
+//A fused handler runs the handlers of its instructions back to back, so
+//flags between them are exactly those of separate dispatches. The loop
+//counts the base cycles of the first instruction; the handler counts the
+//rest. A write that drops the run's own entry ends it before the next
+//instruction. Returns the number of instructions run.
+#define FUSE_STEP(name, op) \
+   cpu->pc += insLen[name]; \
+   FUSE_FN(ins_##name)(cpu, ram, op);
+#define FUSE_NEXT(name, op, ran) \
+   if (0 == ins->len) { \
+      return ran; \
+   } \
+   FUSE_CYCLES(insCycles[name]); \
+   FUSE_STEP(name, op)
+#define FUSE_HANDLER2(a, b) \
+   CORE_INLINE uint32_t FUSE_FN(fuse_##a##_##b)(struct CPU* cpu, struct RAM* ram, const struct DecodedIns* ins) { \
+      FUSE_STEP(a, ins->operand) \
+      FUSE_NEXT(b, ins->operand2, 1) \
+      return 2; \
+   }
+#define FUSE_HANDLER3(a, b, c) \
+   CORE_INLINE uint32_t FUSE_FN(fuse_##a##_##b##_##c)(struct CPU* cpu, struct RAM* ram, const struct DecodedIns* ins) { \
+      FUSE_STEP(a, ins->operand) \
+      FUSE_NEXT(b, ins->operand2, 1) \
+      FUSE_NEXT(c, 0, 2) \
+      return 3; \
+   }
+#define FUSE_ENTRY2(a, b) [FUSE_##a##_##b] = &FUSE_FN(fuse_##a##_##b),
+#define FUSE_ENTRY3(a, b, c) [FUSE_##a##_##b##_##c] = &FUSE_FN(fuse_##a##_##b##_##c),
+
+//Threaded builds expand the handlers at labels of their own instead.
+#ifndef CPU_THREADED_DISPATCH
+#define FUSE_TABLE(table) \
+   static const FusedHandler table[FUSE_COUNT] = { \
+      FUSE_LIST(FUSE_ENTRY2, FUSE_ENTRY3) \
+   };
+#else
+#define FUSE_TABLE(table)
+#endif // !CPU_THREADED_DISPATCH
+
+#define FUSE_FN(fn) fn
+#define FUSE_CYCLES(n) (cpu->cycles += (n))
+FUSE_LIST(FUSE_HANDLER2, FUSE_HANDLER3)
+FUSE_TABLE(fuseTable)
+#undef FUSE_CYCLES
+#undef FUSE_FN
+
+#define FUSE_FN(fn) fn##_fast
+#define FUSE_CYCLES(n) ((void)0)
+FUSE_LIST(FUSE_HANDLER2, FUSE_HANDLER3)
+FUSE_TABLE(fuseTableFast)
+#undef FUSE_CYCLES
+#undef FUSE_FN
+
+#undef FUSE_TABLE
+#undef FUSE_ENTRY3
+#undef FUSE_ENTRY2
+#undef FUSE_HANDLER3
+#undef FUSE_HANDLER2
+#undef FUSE_NEXT
+#undef FUSE_STEP
 
-static void stx_zp(struct CPU* cpu, struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, NONE);
-   w_byte_to_mem(cpu->x, addr, ram, &cpu->cycles);
-}
+#pragma endregion
 
-static void stx_zp_y(struct CPU* cpu, struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, Y);
-   w_byte_to_mem(cpu->x, addr, ram, &cpu->cycles);
-}
+#pragma region Decoder
 
-static void stx_abs(struct CPU* cpu, struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, NONE, false);
-   w_byte_to_mem(cpu->x, addr, ram, &cpu->cycles);
-}
+//The operand is always read as a word; one-byte operands use the low byte.
+static inline void decode_ins(struct DecodedIns* ins, const struct RAM* ram, word pc) {
+   byte opCode;
+   word operand;
+   if (ram->flat) {
+      opCode = ram->data[pc];
+      operand = (word)(ram->data[(word)(pc + 1)] | (ram->data[(word)(pc + 2)] << 8));
+   }
+   else {
+      //Only the bytes of the instruction: past them may be an I/O page,
+      //whose reads can have side effects.
+      opCode = mem_read(ram, pc);
+      operand = (insLen[opCode] > 1) ? mem_read(ram, (word)(pc + 1)) : 0;
+      if (insLen[opCode] > 2) {
+         operand |= (word)(mem_read(ram, (word)(pc + 2)) << 8);
+      }
+   }
+#ifndef CPU_THREADED_DISPATCH
+   ins->handler = insTable[opCode];
+#endif // !CPU_THREADED_DISPATCH
+   ins->opCode = opCode;
+   ins->len = insLen[opCode];
+   ins->cycles = insCycles[opCode];
+   ins->operand = operand;
+   ins->fuse = FUSE_NONE;
+}
+
+//Looks for a fused run that starts with the instruction decoded at pc and
+//records it in the entry. Returns the number of bytes the entry covers.
+//Code on I/O pages is never fused, so the lookahead has no side effects.
+//Fused runs skip the fetch events of all but their first instruction, so
+//there are none while anything observes those; start_trace() and
+//stop_trace() flush the decode cache.
+static byte fuse_ins(struct DecodedIns* ins, const struct RAM* ram, word pc) {
+   const byte* first = ram->readPages[pc >> 8];
+   const byte* last = ram->readPages[(word)(pc + FUSE_SPAN_MAX - 1) >> 8];
+   if (CPU_HOOKS_ENABLED || NULL != ram->trace || NULL == first || NULL == last) {
+      return ins->len;
+   }
 
-static void sty_zp(struct CPU* cpu, struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, NONE);
-   w_byte_to_mem(cpu->y, addr, ram, &cpu->cycles);
-}
+   word next = (word)(pc + ins->len);
+#define CODE_AT(addr) ram->readPages[(word)(addr) >> 8][(addr) & 0xFF]
+   ins->operand2 = (word)(CODE_AT(next + 1) | (CODE_AT(next + 2) << 8));
+#define FUSE_MATCH2(a, b) \
+   if (a == ins->opCode && b == CODE_AT(next)) { \
+      ins->fuse = FUSE_##a##_##b; \
+      return insLen[a] + insLen[b]; \
+   }
+#define FUSE_MATCH3(a, b, c) \
+   if (a == ins->opCode && b == CODE_AT(next) && c == CODE_AT(next + insLen[b])) { \
+      ins->fuse = FUSE_##a##_##b##_##c; \
+      return insLen[a] + insLen[b] + insLen[c]; \
+   }
+   FUSE_LIST(FUSE_MATCH2, FUSE_MATCH3)
+#undef FUSE_MATCH3
+#undef FUSE_MATCH2
+#undef CODE_AT
 
-static void sty_zp_x(struct CPU* cpu, struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, X);
-   w_byte_to_mem(cpu->y, addr, ram, &cpu->cycles);
+   return ins->len;
 }
 
-static void sty_abs(struct CPU* cpu, struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, NONE, false);
-   w_byte_to_mem(cpu->y, addr, ram, &cpu->cycles);
+static inline void mark_code_page(struct RAM* ram, word addr) {
+   ram->codePages[addr >> 11] |= (byte)(1 << ((addr >> 8) & 7));
 }
 
-static void tax(struct CPU* cpu, const struct RAM* ram) {
-   (void)ram; //unused
+//Returns the cached instruction at pc, decoding it on a miss.
+static inline const struct DecodedIns* fetch_cached_ins(struct DecodeCache* cache, struct RAM* ram, word pc) {
+   struct DecodedIns* ins = &cache->ins[pc];
+   if (0 == ins->len) {
+      decode_ins(ins, ram, pc);
+      byte span = fuse_ins(ins, ram, pc);
+      mark_code_page(ram, pc);
+      mark_code_page(ram, pc + span - 1);
+   }
 
-   cpu->x = cpu->a;
-   cpu->cycles++;
-   set_zn_flags(cpu, cpu->x);
+   return ins;
 }
 
-static void txa(struct CPU* cpu, const struct RAM* ram) {
-   (void)ram; //unused
-
-   cpu->a = cpu->x;
-   cpu->cycles++;
-   set_zn_flags(cpu, cpu->a);
+//Records the instruction at cpu->pc with the state it starts from.
+CORE_INLINE void trace_ins(struct TraceRing* ring, const struct CPU* cpu, byte opCode) {
+   struct TraceRecord rec = {
+      .kind = TRACE_INS, .val = opCode, .addr = cpu->pc,
+      .a = cpu->a, .x = cpu->x, .y = cpu->y, .sp = cpu->sp, .ps = pack_ps(cpu),
+      .cycles = (uint32_t)cpu->cycles
+   };
+   trace_push(ring, &rec);
 }
 
-static void tay(struct CPU* cpu, const struct RAM* ram) {
-   (void)ram; //unused
-
-   cpu->y = cpu->a;
-   cpu->cycles++;
-   set_zn_flags(cpu, cpu->y);
+CORE_INLINE void on_fetch(const struct CPU* cpu, const struct RAM* ram, byte opCode) {
+   TRACE_INS(ram, cpu, opCode);
+   CPU_ON_FETCH(cpu, ram, opCode);
 }
 
-static void tya(struct CPU* cpu, const struct RAM* ram) {
-   (void)ram; //unused
-
-   cpu->a = cpu->y;
-   cpu->cycles++;
-   set_zn_flags(cpu, cpu->a);
-}
+#pragma endregion
 
-static void tsx(struct CPU* cpu, const struct RAM* ram) {
-   (void)ram;
+struct RAM* init_ram() {
+   struct RAM* ram = malloc(sizeof(struct RAM));
+   if (NULL == ram) {
+      printf_s("Allocation error.");
+      return NULL;
+   }
 
-   cpu->x = (cpu->sp & 0x00FF);
-   cpu->cycles++;
-   set_zn_flags(cpu, cpu->x);
-}
+   ram->data = (byte*)calloc(MEM_MAX, sizeof(byte)); //Allocate MEM_MAX*1B on the heap.
+   if (NULL == ram->data) {
+      printf_s("Allocation error");
+      free(ram);
+      return NULL;
+   }
+   ram->io = NULL;
+   memset(ram->shared, 0, sizeof(ram->shared));
+   ram->cache = NULL;
+   ram->jit = NULL;
+   ram->trace = NULL;
+   ram->profile = NULL;
+   ram->sched = NULL;
+   memset(ram->codePages, 0, sizeof(ram->codePages));
+   memset(ram->dirtyPages, 0, sizeof(ram->dirtyPages));
+   unmap_pages(ram, 0, PAGE_COUNT);
 
-static void txs(struct CPU* cpu, const struct RAM* ram) {
-   (void)ram;
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Initialized RAM\n");
+#endif // _DEBUG
 
-   cpu->sp = 0x0100 | cpu->x;
-   cpu->cycles++;
+   return ram;
 }
 
-static void pha(struct CPU* cpu, struct RAM* ram) {
-   push_byte_to_stack(ram, &cpu->sp, cpu->a, &cpu->cycles);
-   cpu->cycles++;
-}
+//Does not set RAM ptr to NULL.
+void free_ram(struct RAM* ram) {
+   for (uint32_t p = 0; p < PAGE_COUNT; p++) {
+      release_page(ram, (byte)p);
+   }
+   stop_trace(ram);
+   free_profiler(ram);
+   free_scheduler(ram);
+   free_jit(ram);
+   free(ram->io);
+   free(ram->cache);
+   free(ram->data);
+   free(ram);
 
-static void php(struct CPU* cpu, struct RAM* ram) {
-   push_byte_to_stack(ram, &cpu->sp, cpu->ps, &cpu->cycles);
-   cpu->cycles++;
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Freed allocated memory\n");
+#endif //_DEBUG
 }
 
-static void pla(struct CPU* cpu, const struct RAM* ram) {
-   byte val = pop_byte_from_stack(ram, &cpu->sp, &cpu->cycles);
-   cpu->a = val;
-   cpu->cycles += 2;
-   set_zn_flags(cpu, cpu->a);
-}
+int init_decode_cache(struct RAM* ram) {
+   if (NULL != ram->cache) {
+      return 0;
+   }
 
-static void plp(struct CPU* cpu, const struct RAM* ram) {
-   byte val = pop_byte_from_stack(ram, &cpu->sp, &cpu->cycles);
-   cpu->ps = val;
-   cpu->cycles++;
+   ram->cache = calloc(1, sizeof(struct DecodeCache));
+   if (NULL == ram->cache) {
+      printf_s("Allocation error");
+      return 1;
+   }
 
-   cpu->c = (val & 0b00000001) != 0;
-   cpu->n = (val & 0b10000000) != 0;
-   cpu->v = (val & 0b01000000) != 0;
-   cpu->i = (val & 0b00010000) != 0;
-   cpu->d = (val & 0b00001000) != 0;
-   cpu->b = (val & 0b00000100) != 0;
-   cpu->v = (val & 0b00000010) != 0;
-   cpu->cycles++;
-}
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Initialized decode cache\n");
+#endif // _DEBUG
 
-static void and_imm(struct CPU* cpu, const struct RAM* ram) {
-   logic_ins(cpu, ram, EMPTY_ADDR, AND);
+   return 0;
 }
 
-static void and_zp(struct CPU* cpu, const struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, NONE);
-   logic_ins(cpu, ram, addr, AND);
+void flush_decode_cache(struct RAM* ram) {
+   if (NULL != ram->cache) {
+      memset(ram->cache, 0, sizeof(struct DecodeCache));
+   }
 }
 
-static void and_zp_x(struct CPU* cpu, const struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, X);
-   logic_ins(cpu, ram, addr, AND);
-}
+#pragma region Memory map
 
-static void and_abs(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, NONE, false);
-   logic_ins(cpu, ram, addr, AND);
-}
+//Drops decoded code of page p after its contents changed under it.
+static void invalidate_page(struct RAM* ram, byte p) {
+   if (0 == (ram->codePages[p >> 3] & (1 << (p & 7)))) {
+      return;
+   }
 
-static void and_abs_x(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, X, true);
-   logic_ins(cpu, ram, addr, AND);
+   if (NULL != ram->cache) {
+      for (uint32_t k = 0; k < PAGE_SIZE + FUSE_SPAN_MAX - 1; k++) {
+         ram->cache->ins[(word)(p * PAGE_SIZE - (FUSE_SPAN_MAX - 1) + k)].len = 0;
+      }
+   }
+   flush_jit(ram);
 }
 
-static void and_abs_y(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, Y, true);
-   logic_ins(cpu, ram, addr, AND);
-}
+//Points pages at host memory (NULL for I/O) and drops code decoded from them.
+static int set_pages(struct RAM* ram, byte firstPage, uint32_t pageCount, byte* read, byte* write, bool advanceWrite) {
+   if (pageCount > (uint32_t)PAGE_COUNT - firstPage) {
+      return 1;
+   }
 
-static void and_ind_x(struct CPU* cpu, const struct RAM* ram) {
-   word addr = ind_addr(cpu, ram, X, false);
-   logic_ins(cpu, ram, addr, AND);
-}
+   for (uint32_t k = 0; k < pageCount; k++) {
+      release_page(ram, (byte)(firstPage + k));
+      ram->readPages[firstPage + k] = (NULL != read) ? &read[k * PAGE_SIZE] : NULL;
+      ram->writePages[firstPage + k] = (NULL != write && advanceWrite) ? &write[k * PAGE_SIZE] : write;
+   }
+   ram->flat = is_flat(ram);
 
-static void and_ind_y(struct CPU* cpu, const struct RAM* ram) {
-   word addr = ind_addr(cpu, ram, Y, true);
-   logic_ins(cpu, ram, addr, AND);
-}
+   flush_decode_cache(ram);
+   flush_jit(ram);
 
-static void eor_imm(struct CPU* cpu, const struct RAM* ram) {
-   logic_ins(cpu, ram, EMPTY_ADDR, EOR);
-}
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Mapped pages [0x%X] to [0x%X]\n", firstPage, firstPage + pageCount - 1);
+#endif // _DEBUG
 
-static void eor_zp(struct CPU* cpu, const struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, NONE);
-   logic_ins(cpu, ram, addr, EOR);
+   return 0;
 }
 
-static void eor_zp_x(struct CPU* cpu, const struct RAM* ram) {
-   byte addr = zp_addr(cpu, ram, X);
-   logic_ins(cpu, ram, addr, EOR);
+int map_ram(struct RAM* ram, byte firstPage, uint32_t pageCount, byte* mem) {
+   return set_pages(ram, firstPage, pageCount, mem, mem, true);
 }
 
-static void eor_abs(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, NONE, false);
-   logic_ins(cpu, ram, addr, EOR);
+int map_rom(struct RAM* ram, byte firstPage, uint32_t pageCount, const byte* rom) {
+   //Never written through: writes go to romSink.
+   return set_pages(ram, firstPage, pageCount, (byte*)rom, ram->romSink, false);
 }
 
-static void eor_abs_x(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, X, true);
-   logic_ins(cpu, ram, addr, EOR);
-}
+int map_io(struct RAM* ram, byte firstPage, uint32_t pageCount, IoRead read, IoWrite write, void* ctx) {
+   if (NULL == ram->io) {
+      ram->io = calloc(PAGE_COUNT, sizeof(struct IoPage));
+      if (NULL == ram->io) {
+         printf_s("Allocation error");
+         return 1;
+      }
+   }
+   if (0 != set_pages(ram, firstPage, pageCount, NULL, NULL, false)) {
+      return 1;
+   }
 
-static void eor_abs_y(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, Y, true);
-   logic_ins(cpu, ram, addr, EOR);
+   for (uint32_t k = 0; k < pageCount; k++) {
+      ram->io[firstPage + k] = (struct IoPage){ read, write, ctx };
+   }
+   return 0;
 }
 
-static void eor_ind_x(struct CPU* cpu, const struct RAM* ram) {
-   word addr = ind_addr(cpu, ram, X, false);
-   logic_ins(cpu, ram, addr, EOR);
+void unmap_pages(struct RAM* ram, byte firstPage, uint32_t pageCount) {
+   set_pages(ram, firstPage, pageCount, &ram->data[firstPage * PAGE_SIZE], &ram->data[firstPage * PAGE_SIZE], true);
 }
 
-static void eor_ind_y(struct CPU* cpu, const struct RAM* ram) {
-   word addr = ind_addr(cpu, ram, Y, true);
-   logic_ins(cpu, ram, addr, EOR);
+byte bus_read(const struct RAM* ram, word addr) {
+   return mem_read(ram, addr);
 }
 
-static void ora_imm(struct CPU* cpu, const struct RAM* ram) {
-   logic_ins(cpu, ram, EMPTY_ADDR, ORA);
+void bus_write(struct RAM* ram, word addr, byte val) {
+   mem_write(ram, addr, val);
 }
 
-static void ora_zp(struct CPU* cpu, const struct RAM* ram) {
-   word addr = zp_addr(cpu, ram, NONE);
-   logic_ins(cpu, ram, addr, ORA);
-}
+void bus_write_block(struct RAM* ram, word addr, const byte* src, uint32_t len) {
+   while (len > 0) {
+      byte p = addr >> 8;
+      uint32_t offset = addr & 0xFF;
+      uint32_t chunk = (len < PAGE_SIZE - offset) ? len : PAGE_SIZE - offset;
+      byte* page = ram->writePages[p];
 
-static void ora_zp_x(struct CPU* cpu, const struct RAM* ram) {
-   word addr = zp_addr(cpu, ram, X);
-   logic_ins(cpu, ram, addr, ORA);
-}
+      //Plain RAM takes the whole chunk; ROM, I/O and shared pages go byte by byte.
+      if (NULL != page && page == ram->readPages[p]) {
+         memcpy(&page[offset], src, chunk);
+         mark_dirty(ram, addr);
+         invalidate_page(ram, p);
+      }
+      else {
+         for (uint32_t k = 0; k < chunk; k++) {
+            mem_write(ram, (word)(addr + k), src[k]);
+         }
+      }
 
-static void ora_abs(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, NONE, false);
-   logic_ins(cpu, ram, addr, ORA);
+      addr = (word)(addr + chunk);
+      src += chunk;
+      len -= chunk;
+   }
 }
 
-static void ora_abs_x(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, X, true);
-   logic_ins(cpu, ram, addr, ORA);
+bool is_page_dirty(const struct RAM* ram, byte page) {
+   return 0 != (ram->dirtyPages[page >> 3] & (1 << (page & 7)));
 }
 
-static void ora_abs_y(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, Y, true);
-   logic_ins(cpu, ram, addr, ORA);
-}
+uint32_t next_dirty_page(const struct RAM* ram, uint32_t page) {
+   for (; page < PAGE_COUNT; page++) {
+      byte bits = ram->dirtyPages[page >> 3] >> (page & 7);
+      if (0 != bits) {
+         while (0 == (bits & 1)) {
+            bits >>= 1;
+            page++;
+         }
+         return page;
+      }
+      page |= 7;   //Skip the rest of a clean byte.
+   }
 
-static void ora_ind_x(struct CPU* cpu, const struct RAM* ram) {
-   word addr = ind_addr(cpu, ram, X, false);
-   logic_ins(cpu, ram, addr, ORA);
+   return PAGE_COUNT;
 }
 
-static void ora_ind_y(struct CPU* cpu, const struct RAM* ram) {
-   word addr = ind_addr(cpu, ram, Y, true);
-   logic_ins(cpu, ram, addr, ORA);
+void clear_dirty_pages(struct RAM* ram) {
+   memset(ram->dirtyPages, 0, sizeof(ram->dirtyPages));
 }
 
-static void bit_zp(struct CPU* cpu, const struct RAM* ram) {
-   word addr = zp_addr(cpu, ram, NONE);
-   byte val = r_byte_from_addr(addr, ram, &cpu->cycles);
+#pragma endregion
 
-   byte res = cpu->a & val;
-   set_zn_flags(cpu, res);
-   cpu->v = (res & 0x6) != 0;
-   update_ps(cpu);
-}
+#pragma region Snapshots
 
-static void bit_abs(struct CPU* cpu, const struct RAM* ram) {
-   word addr = abs_addr(cpu, ram, NONE, false);
-   byte val = r_byte_from_addr(addr, ram, &cpu->cycles);
+struct Snapshot* take_snapshot(struct RAM* ram, const struct CPU* cpu) {
+   struct Snapshot* snap = malloc(sizeof(struct Snapshot));
+   if (NULL == snap) {
+      printf_s("Allocation error");
+      return NULL;
+   }
+   snap->cpu = *cpu;
 
-   byte res = cpu->a & val;
-   set_zn_flags(cpu, res);
-   cpu->v = (res & 0x6) != 0;
-   update_ps(cpu);
-}
+   for (uint32_t p = 0; p < PAGE_COUNT; p++) {
+      //ROM and I/O pages are not captured.
+      if (!is_ram_page(ram, (byte)p)) {
+         snap->pages[p] = NULL;
+         continue;
+      }
 
-static void adc_imm(struct CPU* cpu, const struct RAM* ram) {
-   byte val = r_byte_from_pc(&cpu->pc, ram, &cpu->cycles);
-   word sum = cpu->a + val + cpu->c;
-   cpu->a = (byte)sum;
+      //A page not written since the last snapshot still matches its copy.
+      struct SharedPage* page = ram->shared[p];
+      if (NULL == page) {
+         page = malloc(sizeof(struct SharedPage));
+         if (NULL == page) {
+            printf_s("Allocation error");
+            snap->pages[p] = NULL;
+            free_snapshot(snap);
+            return NULL;
+         }
+         page->refs = 1;
+         memcpy(page->data, ram->readPages[p], PAGE_SIZE);
+         ram->shared[p] = page;
+      }
 
-   set_zn_flags(cpu, cpu->a);
-   set_cv_flags(cpu, sum);
-}
+      page->refs++;
+      snap->pages[p] = page;
+      ram->writePages[p] = NULL;
+      ram->flat = false;
+   }
 
-#pragma endregion
+   return snap;
+}
 
-//Instruction map.
-void(*insTable[256])(struct CPU* cpu, struct RAM* ram) = {
-   [JSR] = &jsr,
-   [RTS] = &rts,
-   [LDA_IM] = &lda_imm,
-   [LDA_ZP] = &lda_zp,
-   [LDA_ZPX] = &lda_zp_X,
-   [LDA_ABS] = &lda_abs,
-   [LDA_ABSX] = &lda_abs_X,
-   [LDA_ABSY] = &lda_abs_Y,
-   [LDA_INDX] = &lda_ind_X,
-   [LDA_INDY] = &lda_ind_Y,
-   [LDX_IM] = &ldx_imm,
-   [LDX_ZP] = &ldx_zp,
-   [LDX_ZPY] = &ldx_zp_y,
-   [LDX_ABS] = &ldx_abs,
-   [LDX_ABSY] = &ldx_abs_y,
-   [LDY_IM] = &ldy_imm,
-   [LDY_ZP] = &ldy_zp,
-   [LDY_ZPX] = &ldy_zp_x,
-   [LDY_ABS] = &ldy_abs,
-   [LDY_ABSX] = &ldy_abs_x,
-   [STA_ZP] = &sta_zp,
-   [STA_ZPX] = &sta_zp_x,
-   [STA_ABS] = &sta_abs,
-   [STA_ABSX] = &sta_abs_x,
-   [STA_ABSY] = &sta_abs_y,
-   [STA_INDX] = &sta_ind_x,
-   [STA_INDY] = &sta_ind_y,
-   [STX_ZP] = &stx_zp,
-   [STX_ZPY] = &stx_zp_y,
-   [STX_ABS] = &stx_abs,
-   [STY_ZP] = &sty_zp,
-   [STY_ZPX] = &sty_zp_x,
-   [STY_ABS] = &sty_abs,
-   [TAX] = &tax,
-   [TXA] = &txa,
-   [TAY] = &tay,
-   [TYA] = &tya,
-   [TSX] = &tsx,
-   [TXS] = &txs,
-   [PHA] = &pha,
-   [PHP] = &php,
-   [PLA] = &pla,
-   [PLP] = &plp,
-   [AND_IM] = &and_imm,
-   [AND_ZP] = &and_zp,
-   [AND_ZPX] = &and_zp_x,
-   [AND_ABS] = &and_abs,
-   [AND_ABSX] = &and_abs_x,
-   [AND_ABSY] = &and_abs_y,
-   [AND_INDX] = &and_ind_x,
-   [AND_INDY] = &and_ind_y,
-   [EOR_IM] = &eor_imm,
-   [EOR_ZP] = &eor_zp,
-   [EOR_ZPX] = &eor_zp_x,
-   [EOR_ABS] = &eor_abs,
-   [EOR_ABSX] = &eor_abs_x,
-   [EOR_ABSY] = &eor_abs_y,
-   [EOR_INDX] = &eor_ind_x,
-   [EOR_INDY] = &eor_ind_y,
-   [ORA_IM] = &ora_imm,
-   [ORA_ZP] = &ora_zp,
-   [ORA_ZPX] = &ora_zp_x,
-   [ORA_ABS] = &ora_abs,
-   [ORA_ABSX] = &ora_abs_x,
-   [ORA_ABSY] = &ora_abs_y,
-   [ORA_INDX] = &ora_ind_x,
-   [ORA_INDY] = &ora_ind_y,
-   [BIT_ZP] = &bit_zp,
-   [BIT_ABS] = &bit_abs,
-   [ADC_IM] = &adc_imm,
-};
+void restore_snapshot(struct RAM* ram, struct CPU* cpu, const struct Snapshot* snap) {
+   for (uint32_t p = 0; p < PAGE_COUNT; p++) {
+      struct SharedPage* page = snap->pages[p];
+      if (NULL == page || ram->shared[p] == page || !is_ram_page(ram, (byte)p)) {
+         continue;
+      }
 
-struct RAM* init_ram() {
-   struct RAM* ram = malloc(sizeof(struct RAM));
-   if (NULL == ram) {
-      printf_s("Allocation error.");
-      return NULL;
+      release_page(ram, (byte)p);
+      memcpy(ram->readPages[p], page->data, PAGE_SIZE);
+      page->refs++;
+      ram->shared[p] = page;
+      ram->writePages[p] = NULL;
+      ram->flat = false;
+      mark_dirty(ram, (word)(p * PAGE_SIZE));
+      invalidate_page(ram, (byte)p);
    }
+   *cpu = snap->cpu;
+}
 
-   ram->data = (byte*)calloc(MEM_MAX, sizeof(byte)); //Allocate MEM_MAX*1B on the heap.
-   if (NULL == ram->data) {
-      printf_s("Allocation error");
-      free(ram);
-      return NULL;
+void free_snapshot(struct Snapshot* snap) {
+   if (NULL == snap) {
+      return;
    }
 
-#ifdef _DEBUG
-   printf_s("DEBUG\t| Initialized RAM\n");
-#endif // _DEBUG
-
-   return ram;
+   for (uint32_t p = 0; p < PAGE_COUNT; p++) {
+      release_shared(snap->pages[p]);
+   }
+   free(snap);
 }
 
-//Does not set RAM ptr to NULL.
-void free_ram(struct RAM* ram) {
-   free(ram->data);
-   free(ram);
+size_t snapshot_delta_size(const struct Snapshot* snap, const struct Snapshot* from) {
+   size_t size = sizeof(struct Snapshot);
+   for (uint32_t p = 0; p < PAGE_COUNT; p++) {
+      if (NULL != snap->pages[p] && (NULL == from || from->pages[p] != snap->pages[p])) {
+         size += sizeof(struct SharedPage);
+      }
+   }
 
-#ifdef _DEBUG
-   printf_s("DEBUG\t| Freed allocated memory\n");
-#endif //_DEBUG
+   return size;
 }
 
+#pragma endregion
+
 void reset_cpu(struct CPU* cpu, word sPC) {
    cpu->pc = sPC;
-   cpu->sp = 0x01FF;
+   cpu->sp = 0xFF;
 
    cpu->c = 0;
-   cpu->z = 0;
    cpu->i = 0;
    cpu->d = 0;
    cpu->b = 0;
    cpu->v = 0;
-   cpu->n = 0;
+   cpu->zRes = 0x01;
+   cpu->nRes = 0x00;
 
    cpu->a = 0;
    cpu->x = 0;
    cpu->y = 0;
 
+   cpu->stop = STOP_NONE;
    cpu->cycles = 0;
 
 #ifdef _DEBUG
@@ -761,17 +1082,373 @@ void reset_cpu(struct CPU* cpu, word sPC) {
 #endif // _DEBUG
 }
 
-int exec(struct CPU* cpu, struct RAM* ram, uint32_t insCount) {
-   for (uint32_t i = insCount; i > 0; i--) {
-      byte opCode = r_byte_from_pc(&cpu->pc, ram, &cpu->cycles);
-      
-      if (NULL != insTable[opCode]) {
-         insTable[opCode](cpu, ram);
+byte get_flag(const struct CPU* cpu, StatusFlag flag) {
+   return (pack_ps(cpu) & flag) != 0;
+}
+
+void set_flag(struct CPU* cpu, StatusFlag flag, byte val) {
+   byte ps = pack_ps(cpu);
+   unpack_ps(cpu, val ? (ps | flag) : (ps & ~flag));
+}
+
+byte get_ps(const struct CPU* cpu) {
+   return pack_ps(cpu);
+}
+
+void set_ps(struct CPU* cpu, byte ps) {
+   unpack_ps(cpu, ps);
+}
+
+word get_sp(const struct CPU* cpu) {
+   return STACK_PAGE | cpu->sp;
+}
+
+void set_sp(struct CPU* cpu, word sp) {
+   cpu->sp = (byte)sp;
+}
+
+#ifdef CPU_THREADED_DISPATCH
+#if !defined(__GNUC__)
+#error "CPU_THREADED_DISPATCH requires labels as values (GCC or Clang)."
+#endif
+
+//Threaded dispatch. Every handler is expanded at its own label and jumps
+//straight to the label of the next opcode, so there is no call/return and
+//each handler gets its own indirect branch for the predictor. The engine is
+//expanded once per stop condition and core variant; ENGINE_DONE() is
+//checked before every instruction, ENGINE_FN() picks the handler variant
+//and ENGINE_CYCLES() counts base cycles. ENGINE_FITS(n) tells if a fused
+//run of n instructions may start, and ENGINE_FUSED(n) accounts for the ones
+//it ran after the first. Only the bodies of JAM and the
+//trapped opcodes can stop the CPU, so only they check for it.
+//
+//The registers are copied into regs on entry and back to guest on every
+//exit. Handlers are all inlined here and regs' address never leaves the
+//function, so the compiler can keep PC, A, X, Y, SP and the cycle count in
+//host registers: guest memory writes go through byte pointers, which may
+//alias anything else. Hooks and the trace see regs, which is current.
+#define INS_LABEL(name, opcode, kind, reg, src, mode, cycles) [name] = &&lbl_##name,
+#define INS_STOPS(kind) (OP_JAM == OP_##kind || OP_TRAP == OP_##kind)
+#define INS_BODY(name, opcode, kind, reg, src, mode, cycles) \
+   lbl_##name: \
+   cpu->pc += 1 + MODE_LEN(mode); \
+   ENGINE_FN(ins_##name)(cpu, ram, ins.operand); \
+   if (INS_STOPS(kind)) { \
+      ENGINE_EXIT(1); \
+   } \
+   DISPATCH();
+
+//Fused runs get labels of their own, so their handlers are inlined as well.
+#define FUSE_LABEL2(a, b) [FUSE_##a##_##b] = &&lbl_fuse_##a##_##b,
+#define FUSE_LABEL3(a, b, c) [FUSE_##a##_##b##_##c] = &&lbl_fuse_##a##_##b##_##c,
+#define FUSE_BODY2(a, b) \
+   lbl_fuse_##a##_##b: \
+   ENGINE_FUSED(ENGINE_FN(fuse_##a##_##b)(cpu, ram, entry)); \
+   DISPATCH();
+#define FUSE_BODY3(a, b, c) \
+   lbl_fuse_##a##_##b##_##c: \
+   ENGINE_FUSED(ENGINE_FN(fuse_##a##_##b##_##c)(cpu, ram, entry)); \
+   DISPATCH();
+
+#define ENGINE_EXIT(ret) \
+   do { \
+      *guest = regs; \
+      return (ret); \
+   } while (0)
+
+//The entry is copied so the uncached path can keep it in registers.
+#define DISPATCH() \
+   do { \
+      if (ENGINE_DONE()) { \
+         ENGINE_EXIT(0); \
+      } \
+      if (NULL != cache) { \
+         entry = fetch_cached_ins(cache, ram, cpu->pc); \
+         ins = *entry; \
+      } \
+      else { \
+         decode_ins(&ins, ram, cpu->pc); \
+      } \
+      on_fetch(cpu, ram, ins.opCode); \
+      ENGINE_CYCLES(ins.cycles); \
+      if (FUSE_NONE != ins.fuse && ENGINE_FITS(fuseInfo[ins.fuse].insCount)) { \
+         goto *fused[ins.fuse]; \
+      } \
+      goto *dispatch[ins.opCode]; \
+   } while (0)
+
+#define THREADED_ENGINE() \
+   static const void* const dispatch[256] = { \
+      INS_LIST(INS_LABEL) \
+   }; \
+   static const void* const fused[FUSE_COUNT] = { \
+      FUSE_LIST(FUSE_LABEL2, FUSE_LABEL3) \
+   }; \
+   if (STOP_NONE != guest->stop) { \
+      return 1; \
+   } \
+   struct CPU regs = *guest; \
+   struct CPU* const cpu = &regs; \
+   struct DecodeCache* const cache = ram->cache; \
+   const struct DecodedIns* entry = NULL; \
+   struct DecodedIns ins; \
+   DISPATCH(); \
+   INS_LIST(INS_BODY) \
+   FUSE_LIST(FUSE_BODY2, FUSE_BODY3)
+
+//Instruction count engines. remaining is already decremented for the
+//first instruction of a fused run.
+#define ENGINE_DONE() (0 == remaining--)
+#define ENGINE_FITS(n) (remaining >= (n) - 1u)
+#define ENGINE_FUSED(n) (remaining -= (n) - 1)
+
+#define ENGINE_FN(fn) fn
+#define ENGINE_CYCLES(n) (cpu->cycles += (n))
+int exec_interp(struct CPU* guest, struct RAM* ram, uint32_t insCount) {
+   uint32_t remaining = insCount;
+   THREADED_ENGINE()
+}
+#undef ENGINE_DONE
+#undef ENGINE_FITS
+#undef ENGINE_FUSED
+
+#define ENGINE_DONE() ((int64_t)(*deadline - cpu->cycles) <= 0)
+#define ENGINE_FITS(n) ((int64_t)(*deadline - cpu->cycles) > FUSE_CYCLES_MAX)
+#define ENGINE_FUSED(n) ((void)(n))
+static int exec_interp_cycles(struct CPU* guest, struct RAM* ram, const uint64_t* deadline) {
+   THREADED_ENGINE()
+}
+#undef ENGINE_DONE
+#undef ENGINE_FITS
+#undef ENGINE_FUSED
+#undef ENGINE_CYCLES
+#undef ENGINE_FN
+
+#define ENGINE_DONE() (0 == remaining--)
+#define ENGINE_FITS(n) (remaining >= (n) - 1u)
+#define ENGINE_FUSED(n) (remaining -= (n) - 1)
+#define ENGINE_FN(fn) fn##_fast
+#define ENGINE_CYCLES(n) ((void)0)
+static int exec_interp_fast(struct CPU* guest, struct RAM* ram, uint32_t insCount) {
+   uint32_t remaining = insCount;
+   THREADED_ENGINE()
+}
+#undef ENGINE_CYCLES
+#undef ENGINE_FN
+#undef ENGINE_FUSED
+#undef ENGINE_FITS
+#undef ENGINE_DONE
+
+#undef THREADED_ENGINE
+#undef DISPATCH
+#undef ENGINE_EXIT
+#undef FUSE_BODY3
+#undef FUSE_BODY2
+#undef FUSE_LABEL3
+#undef FUSE_LABEL2
+#undef INS_BODY
+#undef INS_STOPS
+#undef INS_LABEL
+#else
+//Specialized by its callers for RAM with and without a decode cache, so the
+//uncached loop keeps the decoded instruction in registers, for an
+//instruction count or a cycle deadline as the stop condition, and for the
+//cycle-accurate or the functional handlers. Every opcode has a handler; a
+//stopped CPU ends the loop. The handlers are called through pointers, so
+//the registers stay in *cpu here; only the cache pointer is hoisted.
+static inline int exec_loop(struct CPU* cpu, struct RAM* ram, uint32_t insCount, const uint64_t* deadline, bool cached, bool byCycles, bool counted) {
+   struct DecodeCache* const cache = ram->cache;
+   for (uint32_t i = insCount; STOP_NONE == cpu->stop && (byCycles ? (int64_t)(*deadline - cpu->cycles) > 0 : i > 0); i--) {
+      struct DecodedIns decoded;
+      const struct DecodedIns* ins = &decoded;
+      if (cached) {
+         ins = fetch_cached_ins(cache, ram, cpu->pc);
       }
       else {
-         return 1;
+         decode_ins(&decoded, ram, cpu->pc);
+      }
+      on_fetch(cpu, ram, ins->opCode);
+      InsHandler handler = ins->handler;
+      if (counted) {
+         cpu->cycles += ins->cycles;
+      }
+      else {
+         handler = insTableFast[ins->opCode];
+      }
+
+      if (FUSE_NONE != ins->fuse
+         && (byCycles ? (int64_t)(*deadline - cpu->cycles) > FUSE_CYCLES_MAX : i >= fuseInfo[ins->fuse].insCount)) {
+         i -= (counted ? fuseTable : fuseTableFast)[ins->fuse](cpu, ram, ins) - 1;
+         continue;
       }
+      handler(cpu, ram, ins->operand);
    }
 
-   return 0;
+   return STOP_NONE != cpu->stop;
+}
+
+int exec_interp(struct CPU* cpu, struct RAM* ram, uint32_t insCount) {
+   return (NULL != ram->cache)
+      ? exec_loop(cpu, ram, insCount, NULL, true, false, true)
+      : exec_loop(cpu, ram, insCount, NULL, false, false, true);
+}
+
+static int exec_interp_cycles(struct CPU* cpu, struct RAM* ram, const uint64_t* deadline) {
+   return (NULL != ram->cache)
+      ? exec_loop(cpu, ram, 0, deadline, true, true, true)
+      : exec_loop(cpu, ram, 0, deadline, false, true, true);
+}
+
+static int exec_interp_fast(struct CPU* cpu, struct RAM* ram, uint32_t insCount) {
+   return (NULL != ram->cache)
+      ? exec_loop(cpu, ram, insCount, NULL, true, false, false)
+      : exec_loop(cpu, ram, insCount, NULL, false, false, false);
+}
+#endif // CPU_THREADED_DISPATCH
+
+//Interpreter loop for RAM with a profiler attached, shared by both dispatch
+//builds so the loops above carry no profiling code. Frame cycles are added
+//up in mark and only stored when the frame changes. Instructions still run
+//one at a time; fused runs are only counted, as the other loops would
+//dispatch them with a decode cache.
+static int exec_profiled(struct CPU* cpu, struct RAM* ram, uint32_t insCount, const uint64_t* deadline, bool byCycles) {
+   struct Profile* prof = ram->profile;
+   uint64_t mark = cpu->cycles;
+   uint32_t fusedLeft = 0;   //Instructions left of the fused run being counted.
+   for (uint32_t i = insCount; STOP_NONE == cpu->stop && (byCycles ? (int64_t)(*deadline - cpu->cycles) > 0 : i > 0); i--) {
+      struct DecodedIns decoded;
+      const struct DecodedIns* ins = &decoded;
+      if (NULL != ram->cache) {
+         ins = fetch_cached_ins(ram->cache, ram, cpu->pc);
+      }
+      else {
+         decode_ins(&decoded, ram, cpu->pc);
+         fuse_ins(&decoded, ram, cpu->pc);
+      }
+      on_fetch(cpu, ram, ins->opCode);
+
+      if (0 != fusedLeft) {
+         fusedLeft--;
+      }
+      else if (FUSE_NONE != ins->fuse) {
+         prof->fused[ins->fuse]++;
+         fusedLeft = fuseInfo[ins->fuse].insCount - 1;
+      }
+
+      InsHandler handler = insTable[ins->opCode];
+      word pc = cpu->pc;
+      uint64_t start = cpu->cycles;
+      cpu->cycles += ins->cycles;
+      handler(cpu, ram, ins->operand);
+      profile_ins(prof, pc, ins->opCode, cpu->cycles - start);
+
+      if (JSR == ins->opCode || RTS == ins->opCode) {
+         prof->frames[prof->frame].cycles += cpu->cycles - mark;
+         mark = cpu->cycles;
+         if (JSR == ins->opCode) {
+            profile_call(prof, cpu->pc);
+         }
+         else {
+            profile_return(prof);
+         }
+      }
+   }
+
+   prof->frames[prof->frame].cycles += cpu->cycles - mark;
+   return STOP_NONE != cpu->stop;
+}
+
+//Compiled blocks index ram->data directly and neither trace nor call hooks.
+static inline bool can_jit(const struct RAM* ram) {
+   return !CPU_HOOKS_ENABLED && NULL != ram->jit && ram->flat && NULL == ram->trace;
+}
+
+int exec(struct CPU* cpu, struct RAM* ram, uint32_t insCount) {
+   if (NULL != ram->profile) {
+      return exec_profiled(cpu, ram, insCount, NULL, false);
+   }
+   if (can_jit(ram)) {
+      uint64_t deadline = cpu->cycles + INT64_MAX;
+      return exec_jit(cpu, ram, insCount, &deadline);
+   }
+
+   return exec_interp(cpu, ram, insCount);
+}
+
+int exec_fast(struct CPU* cpu, struct RAM* ram, uint32_t insCount) {
+   if (NULL != ram->profile) {
+      return exec_profiled(cpu, ram, insCount, NULL, false);
+   }
+   if (can_jit(ram)) {
+      uint64_t deadline = cpu->cycles + INT64_MAX;
+      return exec_jit(cpu, ram, insCount, &deadline);
+   }
+
+   return exec_interp_fast(cpu, ram, insCount);
+}
+
+//Runs until cpu->cycles reaches *deadline, which is read before every
+//instruction so I/O handlers can pull it in. Compiled blocks only run on
+//flat RAM, which has no I/O handlers.
+static void exec_until(struct CPU* cpu, struct RAM* ram, const uint64_t* deadline) {
+   if (NULL != ram->profile) {
+      exec_profiled(cpu, ram, 0, deadline, true);
+   }
+   else if (can_jit(ram)) {
+      while ((int64_t)(*deadline - cpu->cycles) > 0) {
+         if (0 != exec_jit(cpu, ram, UINT32_MAX, deadline)) {
+            break;
+         }
+      }
+   }
+   else {
+      exec_interp_cycles(cpu, ram, deadline);
+   }
+}
+
+//Pushes PC and P with B clear, sets I and jumps through vector, in the 7
+//cycles BRK takes.
+static void take_interrupt(struct CPU* cpu, struct RAM* ram, word vector) {
+   push_word_to_stack(ram, &cpu->sp, cpu->pc);
+   push_byte_to_stack(ram, &cpu->sp, pack_ps(cpu) & ~FLAG_B);
+   cpu->i = 1;
+   cpu->pc = r_word_from_addr(vector, ram);
+   cpu->cycles += insCycles[BRK];
+}
+
+//Events and interrupts are dealt with between runs. Each run stops at the
+//earlier of the deadline and the next event, so the engines check nothing
+//but the cycle count they already compare against a deadline. While an IRQ
+//is held with I set, CLI, PLP and RTI end the run when they clear I, so it
+//is taken right after.
+static void exec_scheduled(struct CPU* cpu, struct RAM* ram, uint64_t deadline) {
+   struct Scheduler* sched = ram->sched;
+   while (STOP_NONE == cpu->stop && (int64_t)(deadline - cpu->cycles) > 0) {
+      uint64_t next = run_due_events(ram, cpu->cycles);
+      if (sched->nmi) {
+         sched->nmi = false;
+         take_interrupt(cpu, ram, NMI_VECTOR);
+      }
+      else if (0 != sched->irq && 0 == cpu->i) {
+         take_interrupt(cpu, ram, IRQ_VECTOR);
+      }
+
+      sched->limit = (next < deadline) ? next : deadline;
+      exec_until(cpu, ram, &sched->limit);
+   }
+}
+
+//One 64-bit deadline replaces a separate countdown: the remaining budget is
+//deadline - cycles, and handlers only ever add to cycles.
+int64_t exec_cycles(struct CPU* cpu, struct RAM* ram, int64_t budget) {
+   uint64_t deadline = cpu->cycles + (uint64_t)budget;
+
+   if (NULL != ram->sched) {
+      exec_scheduled(cpu, ram, deadline);
+   }
+   else {
+      exec_until(cpu, ram, &deadline);
+   }
+
+   return (int64_t)(cpu->cycles - deadline);
 }
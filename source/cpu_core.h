@@ -0,0 +1,391 @@
+//Interpreter core: the instruction handlers and the helpers that add the
+//cycles an opcode's base count leaves out. No include guard; cpu.c
+//includes this file once per variant with CORE_CYCLES and CORE_SUFFIX set:
+//   CORE_CYCLES 1  cycle-accurate, with page-crossing and branch penalties.
+//   CORE_CYCLES 0  functional, no cycle bookkeeping at all.
+//Function names get CORE_SUFFIX appended. Both macros are undefined at the end.
+
+#define CORE_CAT_(name, suffix) name##suffix
+#define CORE_CAT(name, suffix) CORE_CAT_(name, suffix)
+#define CORE_FN(name) CORE_CAT(name, CORE_SUFFIX)
+
+#if CORE_CYCLES
+#define CPU_CYCLES(n) (cpu->cycles += (n))
+#else
+#define CPU_CYCLES(n) ((void)cpu)
+#endif // CORE_CYCLES
+
+#pragma region Addressing mode helpers
+
+//Operand bytes are fetched by the decoder, so the helpers below only
+//resolve the effective address from the operand. There is one per mode, so
+//no handler switches on its mode at run time. Indexed reads pay the
+//page-crossing cycle only when the index crosses a page; the base count of
+//indexed writes already includes it.
+CORE_INLINE word CORE_FN(addr_MODE_ZP)(struct CPU* cpu, const struct RAM* ram, word op, bool read) {
+   (void)cpu;
+   (void)ram;
+   (void)read;
+
+   return (byte)op;
+}
+
+CORE_INLINE word CORE_FN(addr_MODE_ZPX)(struct CPU* cpu, const struct RAM* ram, word op, bool read) {
+   (void)ram;
+   (void)read;
+
+   return (byte)(op + cpu->x);
+}
+
+CORE_INLINE word CORE_FN(addr_MODE_ZPY)(struct CPU* cpu, const struct RAM* ram, word op, bool read) {
+   (void)ram;
+   (void)read;
+
+   return (byte)(op + cpu->y);
+}
+
+CORE_INLINE word CORE_FN(addr_MODE_ABS)(struct CPU* cpu, const struct RAM* ram, word op, bool read) {
+   (void)cpu;
+   (void)ram;
+   (void)read;
+
+   return op;
+}
+
+CORE_INLINE word CORE_FN(indexed_addr)(struct CPU* cpu, word base, byte idx, bool read) {
+   word addr = base + idx;
+   if (read) {
+      CPU_CYCLES(((base & 0xFF00) != (addr & 0xFF00)) ? 1 : 0);
+   }
+
+   return addr;
+}
+
+CORE_INLINE word CORE_FN(addr_MODE_ABSX)(struct CPU* cpu, const struct RAM* ram, word op, bool read) {
+   (void)ram;
+
+   return CORE_FN(indexed_addr)(cpu, op, cpu->x, read);
+}
+
+CORE_INLINE word CORE_FN(addr_MODE_ABSY)(struct CPU* cpu, const struct RAM* ram, word op, bool read) {
+   (void)ram;
+
+   return CORE_FN(indexed_addr)(cpu, op, cpu->y, read);
+}
+
+CORE_INLINE word CORE_FN(addr_MODE_INDX)(struct CPU* cpu, const struct RAM* ram, word op, bool read) {
+   (void)read;
+
+   byte zpAddr = (byte)(op + cpu->x);
+
+   return r_word_from_addr(zpAddr, ram);
+}
+
+CORE_INLINE word CORE_FN(addr_MODE_INDY)(struct CPU* cpu, const struct RAM* ram, word op, bool read) {
+   word baseAddr = r_word_from_addr((byte)op, ram);
+
+   return CORE_FN(indexed_addr)(cpu, baseAddr, cpu->y, read);
+}
+
+//JMP ($xxFF) takes the high byte of the target from $xx00, as the NMOS
+//6502 does.
+CORE_INLINE word CORE_FN(addr_MODE_IND)(struct CPU* cpu, const struct RAM* ram, word op, bool read) {
+   (void)cpu;
+   (void)read;
+
+   byte loB = r_byte_from_addr(op, ram);
+   byte hiB = r_byte_from_addr((op & 0xFF00) | ((op + 1) & 0x00FF), ram);
+   return (word)(loB | (hiB << 8));
+}
+
+CORE_INLINE byte CORE_FN(read_MODE_IMM)(struct CPU* cpu, const struct RAM* ram, word op) {
+   (void)cpu;
+   (void)ram;
+
+   return (byte)op;
+}
+
+#define CORE_READ_FN(mode) \
+   CORE_INLINE byte CORE_FN(read_##mode)(struct CPU* cpu, const struct RAM* ram, word op) { \
+      return r_byte_from_addr(CORE_FN(addr_##mode)(cpu, ram, op, true), ram); \
+   }
+CORE_READ_FN(MODE_ZP)
+CORE_READ_FN(MODE_ZPX)
+CORE_READ_FN(MODE_ZPY)
+CORE_READ_FN(MODE_ABS)
+CORE_READ_FN(MODE_ABSX)
+CORE_READ_FN(MODE_ABSY)
+CORE_READ_FN(MODE_INDX)
+CORE_READ_FN(MODE_INDY)
+#undef CORE_READ_FN
+
+//Read-modify-write in place. The 6502 spends a cycle writing the old value
+//back while it computes the new one.
+CORE_INLINE byte CORE_FN(modify_MODE_ACC)(struct CPU* cpu, struct RAM* ram, word op, ModifyOp fn) {
+   (void)ram;
+   (void)op;
+
+   cpu->a = fn(cpu, cpu->a);
+   return cpu->a;
+}
+
+#define CORE_MODIFY_FN(mode) \
+   CORE_INLINE byte CORE_FN(modify_##mode)(struct CPU* cpu, struct RAM* ram, word op, ModifyOp fn) { \
+      word addr = CORE_FN(addr_##mode)(cpu, ram, op, false); \
+      byte val = fn(cpu, r_byte_from_addr(addr, ram)); \
+      w_byte_to_mem(val, addr, ram); \
+      return val; \
+   }
+CORE_MODIFY_FN(MODE_ZP)
+CORE_MODIFY_FN(MODE_ZPX)
+CORE_MODIFY_FN(MODE_ABS)
+CORE_MODIFY_FN(MODE_ABSX)
+CORE_MODIFY_FN(MODE_ABSY)
+CORE_MODIFY_FN(MODE_INDX)
+CORE_MODIFY_FN(MODE_INDY)
+#undef CORE_MODIFY_FN
+
+//Taken branches cost a cycle, and one more when they land in another page.
+//PC already points past the branch.
+CORE_INLINE void CORE_FN(branch)(struct CPU* cpu, word op, bool taken) {
+   if (taken) {
+      word target = (word)(cpu->pc + (int8_t)(byte)op);
+      CPU_CYCLES(((cpu->pc & 0xFF00) != (target & 0xFF00)) ? 2 : 1);
+      cpu->pc = target;
+   }
+}
+
+#pragma endregion
+
+#pragma region Instruction handlers
+
+//One handler per INS_LIST entry, named ins_<name>. CORE_OP_<kind> gives the
+//body; CORE_READ and CORE_ADDR resolve to the helpers of the entry's mode.
+#define CORE_REG_G_A a
+#define CORE_REG_G_X x
+#define CORE_REG_G_Y y
+#define CORE_REG(reg) cpu->CORE_CAT(CORE_REG_, reg)
+#define CORE_READ(mode) CORE_FN(CORE_CAT(read_, mode))(cpu, ram, op)
+#define CORE_ADDR(mode, read) CORE_FN(CORE_CAT(addr_, mode))(cpu, ram, op, read)
+#define CORE_MODIFY(mode, fn) CORE_FN(CORE_CAT(modify_, mode))(cpu, ram, op, fn)
+#define CORE_FLAG(flag, val) cpu->flag = (val); on_flags(cpu);
+
+#define CORE_OP_LD(reg, src, mode) \
+   ld_ins(cpu, &CORE_REG(reg), CORE_READ(mode));
+
+#define CORE_OP_ST(reg, src, mode) \
+   word addr = CORE_ADDR(mode, false); \
+   w_byte_to_mem(CORE_REG(reg), addr, ram);
+
+#define CORE_OP_AND(reg, src, mode) logic_ins(cpu, CORE_READ(mode), AND);
+#define CORE_OP_EOR(reg, src, mode) logic_ins(cpu, CORE_READ(mode), EOR);
+#define CORE_OP_ORA(reg, src, mode) logic_ins(cpu, CORE_READ(mode), ORA);
+
+#define CORE_OP_TR(reg, src, mode) \
+   CORE_REG(reg) = CORE_REG(src); \
+   set_zn_flags(cpu, CORE_REG(reg));
+
+#define CORE_OP_TSX(reg, src, mode) \
+   cpu->x = cpu->sp; \
+   set_zn_flags(cpu, cpu->x);
+
+#define CORE_OP_TXS(reg, src, mode) \
+   cpu->sp = cpu->x;
+
+#define CORE_OP_PHA(reg, src, mode) \
+   push_byte_to_stack(ram, &cpu->sp, cpu->a);
+
+#define CORE_OP_PHP(reg, src, mode) \
+   push_byte_to_stack(ram, &cpu->sp, pack_ps(cpu));
+
+#define CORE_OP_PLA(reg, src, mode) \
+   cpu->a = pop_byte_from_stack(ram, &cpu->sp); \
+   set_zn_flags(cpu, cpu->a);
+
+#define CORE_OP_PLP(reg, src, mode) \
+   byte val = pop_byte_from_stack(ram, &cpu->sp); \
+   unpack_ps(cpu, val); \
+   check_irq_unmasked(cpu, ram);
+
+//Z comes from A & M, N and V straight from bits 7 and 6 of M.
+#define CORE_OP_BIT(reg, src, mode) \
+   byte val = CORE_READ(mode); \
+   cpu->zRes = cpu->a & val; \
+   cpu->nRes = val; \
+   cpu->v = (val >> 6) & 1; \
+   on_flags(cpu);
+
+#define CORE_OP_ADC(reg, src, mode) adc_ins(cpu, CORE_READ(mode));
+#define CORE_OP_SBC(reg, src, mode) sbc_ins(cpu, CORE_READ(mode));
+#define CORE_OP_CMP(reg, src, mode) cmp_ins(cpu, CORE_REG(reg), CORE_READ(mode));
+
+#define CORE_OP_ASL(reg, src, mode) set_zn_flags(cpu, CORE_MODIFY(mode, asl_op));
+#define CORE_OP_LSR(reg, src, mode) set_zn_flags(cpu, CORE_MODIFY(mode, lsr_op));
+#define CORE_OP_ROL(reg, src, mode) set_zn_flags(cpu, CORE_MODIFY(mode, rol_op));
+#define CORE_OP_ROR(reg, src, mode) set_zn_flags(cpu, CORE_MODIFY(mode, ror_op));
+#define CORE_OP_INC(reg, src, mode) set_zn_flags(cpu, CORE_MODIFY(mode, inc_op));
+#define CORE_OP_DEC(reg, src, mode) set_zn_flags(cpu, CORE_MODIFY(mode, dec_op));
+
+#define CORE_OP_INCR(reg, src, mode) \
+   CORE_REG(reg)++; \
+   set_zn_flags(cpu, CORE_REG(reg));
+
+#define CORE_OP_DECR(reg, src, mode) \
+   CORE_REG(reg)--; \
+   set_zn_flags(cpu, CORE_REG(reg));
+
+#define CORE_OP_CLC(reg, src, mode) CORE_FLAG(c, 0)
+#define CORE_OP_SEC(reg, src, mode) CORE_FLAG(c, 1)
+#define CORE_OP_CLI(reg, src, mode) CORE_FLAG(i, 0) check_irq_unmasked(cpu, ram);
+#define CORE_OP_SEI(reg, src, mode) CORE_FLAG(i, 1)
+#define CORE_OP_CLV(reg, src, mode) CORE_FLAG(v, 0)
+#define CORE_OP_CLD(reg, src, mode) CORE_FLAG(d, 0)
+#define CORE_OP_SED(reg, src, mode) CORE_FLAG(d, 1)
+
+#define CORE_OP_NOP(reg, src, mode)
+//Undocumented NOPs with an operand read it like any other instruction.
+#define CORE_OP_SKP(reg, src, mode) (void)CORE_READ(mode);
+
+#define CORE_OP_SLO(reg, src, mode) logic_ins(cpu, CORE_MODIFY(mode, asl_op), ORA);
+#define CORE_OP_RLA(reg, src, mode) logic_ins(cpu, CORE_MODIFY(mode, rol_op), AND);
+#define CORE_OP_SRE(reg, src, mode) logic_ins(cpu, CORE_MODIFY(mode, lsr_op), EOR);
+#define CORE_OP_RRA(reg, src, mode) adc_ins(cpu, CORE_MODIFY(mode, ror_op));
+#define CORE_OP_DCP(reg, src, mode) cmp_ins(cpu, cpu->a, CORE_MODIFY(mode, dec_op));
+#define CORE_OP_ISC(reg, src, mode) sbc_ins(cpu, CORE_MODIFY(mode, inc_op));
+
+#define CORE_OP_SAX(reg, src, mode) \
+   word addr = CORE_ADDR(mode, false); \
+   w_byte_to_mem(cpu->a & cpu->x, addr, ram);
+
+#define CORE_OP_LAX(reg, src, mode) \
+   ld_ins(cpu, &cpu->a, CORE_READ(mode)); \
+   cpu->x = cpu->a;
+
+#define CORE_OP_ANC(reg, src, mode) anc_ins(cpu, CORE_READ(mode));
+#define CORE_OP_ALR(reg, src, mode) alr_ins(cpu, CORE_READ(mode));
+#define CORE_OP_ARR(reg, src, mode) arr_ins(cpu, CORE_READ(mode));
+#define CORE_OP_SBX(reg, src, mode) sbx_ins(cpu, CORE_READ(mode));
+#define CORE_OP_LAS(reg, src, mode) las_ins(cpu, CORE_READ(mode));
+
+#define CORE_OP_JSR(reg, src, mode) \
+   push_word_to_stack(ram, &cpu->sp, cpu->pc - 1); \
+   cpu->pc = op;
+
+#define CORE_OP_RTS(reg, src, mode) \
+   word addr = pop_word_from_stack(ram, &cpu->sp); \
+   cpu->pc = addr + 1;
+
+#define CORE_OP_JMP(reg, src, mode) cpu->pc = CORE_ADDR(mode, true);
+
+//BRK pushes the address past its padding byte and P with B set.
+#define CORE_OP_BRK(reg, src, mode) \
+   push_word_to_stack(ram, &cpu->sp, cpu->pc); \
+   push_byte_to_stack(ram, &cpu->sp, pack_ps(cpu) | FLAG_B); \
+   cpu->i = 1; \
+   cpu->pc = r_word_from_addr(IRQ_VECTOR, ram);
+
+#define CORE_OP_RTI(reg, src, mode) \
+   unpack_ps(cpu, pop_byte_from_stack(ram, &cpu->sp)); \
+   cpu->pc = pop_word_from_stack(ram, &cpu->sp); \
+   check_irq_unmasked(cpu, ram);
+
+#define CORE_OP_BPL(reg, src, mode) CORE_FN(branch)(cpu, op, 0 == (cpu->nRes & 0x80));
+#define CORE_OP_BMI(reg, src, mode) CORE_FN(branch)(cpu, op, 0 != (cpu->nRes & 0x80));
+#define CORE_OP_BVC(reg, src, mode) CORE_FN(branch)(cpu, op, 0 == cpu->v);
+#define CORE_OP_BVS(reg, src, mode) CORE_FN(branch)(cpu, op, 0 != cpu->v);
+#define CORE_OP_BCC(reg, src, mode) CORE_FN(branch)(cpu, op, 0 == cpu->c);
+#define CORE_OP_BCS(reg, src, mode) CORE_FN(branch)(cpu, op, 0 != cpu->c);
+#define CORE_OP_BNE(reg, src, mode) CORE_FN(branch)(cpu, op, 0 != cpu->zRes);
+#define CORE_OP_BEQ(reg, src, mode) CORE_FN(branch)(cpu, op, 0 == cpu->zRes);
+
+#define CORE_OP_JAM(reg, src, mode) cpu->stop = STOP_JAM;
+#define CORE_OP_TRAP(reg, src, mode) cpu->stop = STOP_UNSTABLE;
+
+#define CORE_HANDLER(name, opcode, kind, reg, src, mode, cycles) \
+   CORE_INLINE void CORE_FN(ins_##name)(struct CPU* cpu, struct RAM* ram, word op) { \
+      (void)cpu; \
+      (void)ram; \
+      (void)op; \
+      CORE_OP_##kind(reg, src, mode) \
+   }
+INS_LIST(CORE_HANDLER)
+#undef CORE_HANDLER
+
+#undef CORE_OP_TRAP
+#undef CORE_OP_JAM
+#undef CORE_OP_BEQ
+#undef CORE_OP_BNE
+#undef CORE_OP_BCS
+#undef CORE_OP_BCC
+#undef CORE_OP_BVS
+#undef CORE_OP_BVC
+#undef CORE_OP_BMI
+#undef CORE_OP_BPL
+#undef CORE_OP_RTI
+#undef CORE_OP_BRK
+#undef CORE_OP_JMP
+#undef CORE_OP_RTS
+#undef CORE_OP_JSR
+#undef CORE_OP_LAS
+#undef CORE_OP_SBX
+#undef CORE_OP_ARR
+#undef CORE_OP_ALR
+#undef CORE_OP_ANC
+#undef CORE_OP_LAX
+#undef CORE_OP_SAX
+#undef CORE_OP_ISC
+#undef CORE_OP_DCP
+#undef CORE_OP_RRA
+#undef CORE_OP_SRE
+#undef CORE_OP_RLA
+#undef CORE_OP_SLO
+#undef CORE_OP_SKP
+#undef CORE_OP_NOP
+#undef CORE_OP_SED
+#undef CORE_OP_CLD
+#undef CORE_OP_CLV
+#undef CORE_OP_SEI
+#undef CORE_OP_CLI
+#undef CORE_OP_SEC
+#undef CORE_OP_CLC
+#undef CORE_OP_DECR
+#undef CORE_OP_INCR
+#undef CORE_OP_DEC
+#undef CORE_OP_INC
+#undef CORE_OP_ROR
+#undef CORE_OP_ROL
+#undef CORE_OP_LSR
+#undef CORE_OP_ASL
+#undef CORE_OP_CMP
+#undef CORE_OP_SBC
+#undef CORE_OP_ADC
+#undef CORE_OP_BIT
+#undef CORE_OP_PLP
+#undef CORE_OP_PLA
+#undef CORE_OP_PHP
+#undef CORE_OP_PHA
+#undef CORE_OP_TXS
+#undef CORE_OP_TSX
+#undef CORE_OP_TR
+#undef CORE_OP_ORA
+#undef CORE_OP_EOR
+#undef CORE_OP_AND
+#undef CORE_OP_ST
+#undef CORE_OP_LD
+#undef CORE_FLAG
+#undef CORE_MODIFY
+#undef CORE_ADDR
+#undef CORE_READ
+#undef CORE_REG
+#undef CORE_REG_G_Y
+#undef CORE_REG_G_X
+#undef CORE_REG_G_A
+
+#pragma endregion
+
+#undef CPU_CYCLES
+#undef CORE_FN
+#undef CORE_CAT
+#undef CORE_CAT_
+#undef CORE_SUFFIX
+#undef CORE_CYCLES
@@ -0,0 +1,641 @@
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE   //MAP_ANONYMOUS with -std=c11
+#endif
+
+#include "../include/jit.h"
+#include "../include/optable.h"
+#include "../include/sched.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <stddef.h>
+#include <sys/mman.h>
+
+#define JIT_ARENA_SIZE (1024 * 1024)
+#define JIT_MAX_BLOCKS 4096
+#define JIT_MAX_INS 32
+#define JIT_MAX_BLOCK_BYTES 8192   //Worst case for JIT_MAX_INS instructions, with room to spare.
+#define JIT_HOT_THRESHOLD 16       //Block entries before a PC is compiled.
+#define JIT_COLD 0xFF              //Heat of entry points that cannot be compiled.
+
+typedef uint32_t(*JitFn)(struct CPU* cpu, struct RAM* ram);
+
+//A compiled block returns the number of guest instructions it executed.
+//That is insCount unless a store hit code and the block left early.
+struct JitBlock {
+   JitFn fn;
+   word start;
+   uint32_t end;        //One past the last byte.
+   uint32_t insCount;
+   bool dead;
+   struct JitBlock* next[2];   //Links in the lists of the first and last page.
+};
+
+struct Jit {
+   byte* arena;
+   size_t used;
+   uint32_t blockCount;
+   bool invalidated;    //Set by invalidate_jit() when a live block was dropped.
+   struct JitBlock* blocks[MEM_MAX];
+   struct JitBlock* pageBlocks[PAGE_COUNT];
+   byte heat[MEM_MAX];
+   struct JitBlock pool[JIT_MAX_BLOCKS];
+};
+
+#pragma region Emitter
+
+//Host registers. Guest A/X/Y and the block's pointers live in callee-saved
+//registers so they survive calls into C; rax, rcx, rdx, rsi and rdi are
+//scratch.
+enum {
+   NO_REG = -1,
+   RAX = 0, RCX = 1, RDX = 2, RBX = 3, RBP = 5, RSI = 6, RDI = 7,
+   R12 = 12, R13 = 13, R14 = 14, R15 = 15
+};
+
+#define HOST_CPU R15
+#define HOST_MEM R14   //ram->data
+#define HOST_RAM RBP
+
+static const int hostReg[] = { RBX, R12, R13 };
+
+struct Emitter {
+   byte* p;
+   byte* end;
+   bool overflow;
+};
+
+static void emit8(struct Emitter* e, uint32_t val) {
+   if (e->p < e->end) {
+      *e->p++ = (byte)val;
+   } else {
+      e->overflow = true;
+   }
+}
+
+static void emit16(struct Emitter* e, uint32_t val) {
+   emit8(e, val);
+   emit8(e, val >> 8);
+}
+
+static void emit32(struct Emitter* e, uint32_t val) {
+   emit16(e, val);
+   emit16(e, val >> 16);
+}
+
+static void emit_bytes(struct Emitter* e, const byte* code, size_t len) {
+   for (size_t i = 0; i < len; i++) {
+      emit8(e, code[i]);
+   }
+}
+
+static inline int hi_bit(int reg) {
+   return (reg < 0) ? 0 : (reg >> 3) & 1;
+}
+
+//Opcodes above 0xFF are two-byte 0x0F escapes.
+static void emit_opcode(struct Emitter* e, bool w, uint32_t op, int reg, int index, int base) {
+   byte rex = (byte)(0x40 | (w << 3) | (hi_bit(reg) << 2) | (hi_bit(index) << 1) | hi_bit(base));
+   if (0x40 != rex) {
+      emit8(e, rex);
+   }
+   if (op > 0xFF) {
+      emit8(e, op >> 8);
+   }
+   emit8(e, op & 0xFF);
+}
+
+//op reg, [base + index + disp]
+static void emit_mem(struct Emitter* e, bool w, uint32_t op, int reg, int base, int index, int32_t disp) {
+   emit_opcode(e, w, op, reg, index, base);
+
+   int mod = (0 == disp && 5 != (base & 7)) ? 0 : (disp >= -128 && disp <= 127) ? 1 : 2;
+   if (NO_REG == index && 4 != (base & 7)) {
+      emit8(e, (mod << 6) | ((reg & 7) << 3) | (base & 7));
+   } else {
+      emit8(e, (mod << 6) | ((reg & 7) << 3) | 4);
+      emit8(e, (((NO_REG == index) ? 4 : index) & 7) << 3 | (base & 7));
+   }
+
+   if (1 == mod) {
+      emit8(e, (uint32_t)disp);
+   } else if (2 == mod) {
+      emit32(e, (uint32_t)disp);
+   }
+}
+
+//op rm, reg (or op reg, rm, depending on the opcode)
+static void emit_rr(struct Emitter* e, bool w, uint32_t op, int reg, int rm) {
+   emit_opcode(e, w, op, reg, NO_REG, rm);
+   emit8(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void emit_mov_imm(struct Emitter* e, int dst, uint32_t imm) {
+   if (dst >= 8) {
+      emit8(e, 0x41);
+   }
+   emit8(e, 0xB8 | (dst & 7));
+   emit32(e, imm);
+}
+
+static byte* emit_jcc(struct Emitter* e, byte cc) {
+   emit8(e, 0x0F);
+   emit8(e, 0x80 | cc);
+   byte* rel = e->p;
+   emit32(e, 0);
+   return rel;
+}
+
+static void patch_jump(struct Emitter* e, byte* rel) {
+   if (!e->overflow) {
+      int32_t dist = (int32_t)(e->p - (rel + 4));
+      memcpy(rel, &dist, sizeof(dist));
+   }
+}
+
+#define CC_AE 0x3
+#define CC_Z 0x4
+
+#pragma endregion
+
+#pragma region Code generation
+
+static void emit_load_regs(struct Emitter* e) {
+   emit_mem(e, false, 0x0FB6, hostReg[G_A], HOST_CPU, NO_REG, offsetof(struct CPU, a));
+   emit_mem(e, false, 0x0FB6, hostReg[G_X], HOST_CPU, NO_REG, offsetof(struct CPU, x));
+   emit_mem(e, false, 0x0FB6, hostReg[G_Y], HOST_CPU, NO_REG, offsetof(struct CPU, y));
+}
+
+//znReg holds the last Z/N result, or is NO_REG when the block has not
+//produced one since the last write back.
+static void emit_store_regs(struct Emitter* e, int znReg) {
+   emit_mem(e, false, 0x88, hostReg[G_A], HOST_CPU, NO_REG, offsetof(struct CPU, a));
+   emit_mem(e, false, 0x88, hostReg[G_X], HOST_CPU, NO_REG, offsetof(struct CPU, x));
+   emit_mem(e, false, 0x88, hostReg[G_Y], HOST_CPU, NO_REG, offsetof(struct CPU, y));
+   if (NO_REG != znReg) {
+      emit_mem(e, false, 0x88, znReg, HOST_CPU, NO_REG, offsetof(struct CPU, zRes));
+      emit_mem(e, false, 0x88, znReg, HOST_CPU, NO_REG, offsetof(struct CPU, nRes));
+   }
+}
+
+static void emit_pc_cycles(struct Emitter* e, word pc, uint32_t cycles) {
+   emit8(e, 0x66);
+   emit_mem(e, false, 0xC7, 0, HOST_CPU, NO_REG, offsetof(struct CPU, pc));
+   emit16(e, pc);
+   if (0 != cycles) {
+      emit_mem(e, true, 0x81, 0, HOST_CPU, NO_REG, offsetof(struct CPU, cycles));
+      emit32(e, cycles);
+   }
+}
+
+static void emit_call(struct Emitter* e, uint32_t (*fn)()) {
+   uint64_t addr = (uint64_t)(uintptr_t)fn;
+   emit8(e, 0x48);                           //mov rax, fn
+   emit8(e, 0xB8);
+   emit32(e, (uint32_t)addr);
+   emit32(e, (uint32_t)(addr >> 32));
+   emit8(e, 0xFF);                           //call rax
+   emit8(e, 0xD0);
+}
+
+static void emit_prologue(struct Emitter* e) {
+   static const byte code[] = {
+      0x53,                      //push rbx
+      0x55,                      //push rbp
+      0x41, 0x54,                //push r12
+      0x41, 0x55,                //push r13
+      0x41, 0x56,                //push r14
+      0x41, 0x57,                //push r15
+      0x48, 0x83, 0xEC, 0x08,    //sub rsp, 8
+      0x49, 0x89, 0xFF,          //mov r15, rdi
+      0x48, 0x89, 0xF5           //mov rbp, rsi
+   };
+   emit_bytes(e, code, sizeof(code));
+
+   emit_mem(e, true, 0x8B, HOST_MEM, HOST_RAM, NO_REG, offsetof(struct RAM, data));
+   emit_load_regs(e);
+}
+
+//Writes the guest state back and returns insCount.
+static void emit_exit(struct Emitter* e, word pc, uint32_t cycles, uint32_t insCount, int znReg) {
+   static const byte code[] = {
+      0x48, 0x83, 0xC4, 0x08,    //add rsp, 8
+      0x41, 0x5F,                //pop r15
+      0x41, 0x5E,                //pop r14
+      0x41, 0x5D,                //pop r13
+      0x41, 0x5C,                //pop r12
+      0x5D,                      //pop rbp
+      0x5B,                      //pop rbx
+      0xC3                       //ret
+   };
+
+   emit_store_regs(e, znReg);
+   emit_pc_cycles(e, pc, cycles);
+   emit_mov_imm(e, RAX, insCount);
+   emit_bytes(e, code, sizeof(code));
+}
+
+//Called by compiled code for stores to pages flagged as code. Returns
+//nonzero when a compiled block was dropped, as it may be the running one.
+static uint32_t jit_write_hook(struct RAM* ram, uint32_t addr) {
+   ram->jit->invalidated = false;
+   invalidate_code_at(ram, (word)addr);
+   return ram->jit->invalidated;
+}
+
+//Called by compiled code for a run of OP_INTERP instructions, with the guest
+//state written back. Returns nonzero when a compiled block was dropped, or
+//when the scheduler wants the CPU back: CLI and PLP end their run, and a
+//held IRQ they unmask pulls the limit in.
+static uint32_t jit_interp_hook(struct CPU* cpu, struct RAM* ram, uint32_t insCount) {
+   ram->jit->invalidated = false;
+   exec_interp(cpu, ram, insCount);
+   return ram->jit->invalidated || (NULL != ram->sched && (int64_t)(ram->sched->limit - cpu->cycles) <= 0);
+}
+
+//Guest state at the end of the instruction being compiled, for early exits.
+//cycles are the ones not yet added to cpu->cycles.
+struct ExitState {
+   word pc;
+   uint32_t cycles;
+   uint32_t insCount;
+   int znReg;
+};
+
+//Computes the effective address. Returns true with a constant address in
+//*addr, or false with the address in eax.
+static bool emit_addr(struct Emitter* e, const struct OpInfo* info, word operand, bool canPageCross, word* addr) {
+   switch (info->mode) {
+   case MODE_ZP:
+      *addr = operand & 0xFF;
+      return true;
+   case MODE_ABS:
+      *addr = operand;
+      return true;
+   case MODE_ZPX:
+   case MODE_ZPY:
+      emit_mem(e, false, 0x8D, RAX, hostReg[(MODE_ZPX == info->mode) ? G_X : G_Y], NO_REG, operand & 0xFF);
+      emit_rr(e, false, 0x0FB6, RAX, RAX);   //movzx eax, al
+      return false;
+   default: {
+      int idx = hostReg[(MODE_ABSX == info->mode) ? G_X : G_Y];
+      emit_mem(e, false, 0x8D, RAX, idx, NO_REG, operand);
+      emit_rr(e, false, 0x0FB7, RAX, RAX);   //movzx eax, ax
+      if (canPageCross) {
+         //cycles += (index + low byte) >> 8
+         emit_mem(e, false, 0x8D, RCX, idx, NO_REG, operand & 0xFF);
+         emit_rr(e, false, 0xC1, 5, RCX);
+         emit8(e, 8);
+         emit_mem(e, true, 0x01, RCX, HOST_CPU, NO_REG, offsetof(struct CPU, cycles));
+      }
+      return false;
+   }
+   }
+}
+
+static void emit_read(struct Emitter* e, const struct OpInfo* info, word operand, int dst) {
+   if (MODE_IMM == info->mode) {
+      emit_mov_imm(e, dst, operand & 0xFF);
+      return;
+   }
+
+   word addr;
+   if (emit_addr(e, info, operand, true, &addr)) {
+      emit_mem(e, false, 0x0FB6, dst, HOST_MEM, NO_REG, addr);
+   } else {
+      emit_mem(e, false, 0x0FB6, dst, HOST_MEM, RAX, 0);
+   }
+}
+
+//Stores src and, if the page holds code, runs the invalidation hook and
+//leaves the block when it dropped compiled code. CPU_DIRTY_PAGES builds also
+//mark the page dirty.
+static void emit_write(struct Emitter* e, int src, bool isConst, word addr, const struct ExitState* exit) {
+   int32_t pagesOffset = offsetof(struct RAM, codePages);
+   byte* notCode;
+
+   if (isConst) {
+      emit_mem(e, false, 0x88, src, HOST_MEM, NO_REG, addr);
+#ifdef CPU_DIRTY_PAGES
+      emit_mem(e, false, 0x80, 1, HOST_RAM, NO_REG, offsetof(struct RAM, dirtyPages) + (addr >> 11));   //or byte
+      emit8(e, 1 << ((addr >> 8) & 7));
+#endif // CPU_DIRTY_PAGES
+      emit_mem(e, false, 0xF6, 0, HOST_RAM, NO_REG, pagesOffset + (addr >> 11));
+      emit8(e, 1 << ((addr >> 8) & 7));
+      notCode = emit_jcc(e, CC_Z);
+      emit_mov_imm(e, RSI, addr);
+   } else {
+      emit_mem(e, false, 0x88, src, HOST_MEM, RAX, 0);
+      emit_rr(e, false, 0x89, RAX, RCX);     //mov ecx, eax
+      emit_rr(e, false, 0xC1, 5, RCX);       //shr ecx, 8
+      emit8(e, 8);
+#ifdef CPU_DIRTY_PAGES
+      emit_mem(e, false, 0x0FAB, RCX, HOST_RAM, NO_REG, offsetof(struct RAM, dirtyPages));   //bts before bt: both set CF
+#endif // CPU_DIRTY_PAGES
+      emit_mem(e, false, 0x0FA3, RCX, HOST_RAM, NO_REG, pagesOffset);
+      notCode = emit_jcc(e, CC_AE);
+      emit_rr(e, false, 0x89, RAX, RSI);     //mov esi, eax
+   }
+
+   emit_rr(e, true, 0x89, HOST_RAM, RDI);    //mov rdi, rbp
+   emit_call(e, (uint32_t(*)())&jit_write_hook);
+   emit_rr(e, false, 0x85, RAX, RAX);        //test eax, eax
+   byte* stillValid = emit_jcc(e, CC_Z);
+   emit_exit(e, exit->pc, exit->cycles, exit->insCount, exit->znReg);
+
+   patch_jump(e, notCode);
+   patch_jump(e, stillValid);
+}
+
+//Hands insCount instructions at pc to the interpreter. The interpreter
+//counts their cycles and leaves Z/N in the CPU, so both start over in state.
+static void emit_interp_call(struct Emitter* e, word pc, uint32_t insCount, struct ExitState* state) {
+   emit_store_regs(e, state->znReg);
+   emit_pc_cycles(e, pc, state->cycles);
+   emit_rr(e, true, 0x89, HOST_CPU, RDI);    //mov rdi, r15
+   emit_rr(e, true, 0x89, HOST_RAM, RSI);    //mov rsi, rbp
+   emit_mov_imm(e, RDX, insCount);
+   emit_call(e, (uint32_t(*)())&jit_interp_hook);
+   emit_load_regs(e);
+
+   state->cycles = 0;
+   state->znReg = NO_REG;
+   emit_rr(e, false, 0x85, RAX, RAX);        //test eax, eax
+   byte* stillValid = emit_jcc(e, CC_Z);
+   emit_exit(e, state->pc, state->cycles, state->insCount, state->znReg);
+   patch_jump(e, stillValid);
+}
+
+//Returns the register holding the last Z/N result after the instruction.
+static int emit_ins(struct Emitter* e, const struct OpInfo* info, word operand, const struct ExitState* exit) {
+   int reg = hostReg[info->reg];
+   word addr = 0;
+
+   switch (info->kind) {
+   case OP_LD:
+      emit_read(e, info, operand, reg);
+      return reg;
+   case OP_ST: {
+      bool isConst = emit_addr(e, info, operand, false, &addr);
+      emit_write(e, reg, isConst, addr, exit);
+      return exit->znReg;
+   }
+   case OP_AND:
+   case OP_EOR:
+   case OP_ORA: {
+      static const byte aluOp[] = { [OP_AND] = 0x21, [OP_EOR] = 0x31, [OP_ORA] = 0x09 };
+      static const byte aluExt[] = { [OP_AND] = 4, [OP_EOR] = 6, [OP_ORA] = 1 };
+      if (MODE_IMM == info->mode) {
+         emit_rr(e, false, 0x81, aluExt[info->kind], RBX);
+         emit32(e, operand & 0xFF);
+      } else {
+         emit_read(e, info, operand, RCX);
+         emit_rr(e, false, aluOp[info->kind], RCX, RBX);
+      }
+      return RBX;
+   }
+   case OP_TR:
+      emit_rr(e, false, 0x89, hostReg[info->src], reg);
+      return reg;
+   case OP_TSX:
+      emit_mem(e, false, 0x0FB6, reg, HOST_CPU, NO_REG, offsetof(struct CPU, sp));
+      return reg;
+   case OP_TXS:
+      emit_mem(e, false, 0x88, reg, HOST_CPU, NO_REG, offsetof(struct CPU, sp));
+      return exit->znReg;
+   case OP_PHA:
+      emit_mem(e, false, 0x0FB6, RAX, HOST_CPU, NO_REG, offsetof(struct CPU, sp));
+      emit_rr(e, false, 0xFE, 1, RAX);       //dec al
+      emit_mem(e, false, 0x88, RAX, HOST_CPU, NO_REG, offsetof(struct CPU, sp));
+      emit_rr(e, false, 0x0FB6, RAX, RAX);   //movzx eax, al
+      emit_rr(e, false, 0x81, 1, RAX);       //or eax, 0x100
+      emit32(e, 0x100);
+      emit_write(e, reg, false, 0, exit);
+      return exit->znReg;
+   default: //OP_PLA: reads [sp], then increments it, as pop_byte_from_stack() does
+      emit_mem(e, false, 0x0FB6, RAX, HOST_CPU, NO_REG, offsetof(struct CPU, sp));
+      emit_mem(e, false, 0x0FB6, reg, HOST_MEM, RAX, 0x100);
+      emit_rr(e, false, 0xFE, 0, RAX);       //inc al
+      emit_mem(e, false, 0x88, RAX, HOST_CPU, NO_REG, offsetof(struct CPU, sp));
+      return reg;
+   }
+}
+
+#pragma endregion
+
+static void reset_jit(struct Jit* jit) {
+   jit->used = 0;
+   jit->blockCount = 0;
+   memset(jit->blocks, 0, sizeof(jit->blocks));
+   memset(jit->pageBlocks, 0, sizeof(jit->pageBlocks));
+   memset(jit->heat, 0, sizeof(jit->heat));
+}
+
+static void link_block(struct Jit* jit, struct RAM* ram, struct JitBlock* blk) {
+   byte first = blk->start >> 8;
+   byte last = (blk->end - 1) >> 8;
+
+   blk->next[0] = jit->pageBlocks[first];
+   jit->pageBlocks[first] = blk;
+   blk->next[1] = NULL;
+   if (last != first) {
+      blk->next[1] = jit->pageBlocks[last];
+      jit->pageBlocks[last] = blk;
+   }
+
+   ram->codePages[first >> 3] |= (byte)(1 << (first & 7));
+   ram->codePages[last >> 3] |= (byte)(1 << (last & 7));
+   jit->blocks[blk->start] = blk;
+}
+
+//Compiles the straight-line run of supported instructions at start.
+//Returns NULL if there is none or the arena could not be written.
+static struct JitBlock* compile_block(struct Jit* jit, struct RAM* ram, word start) {
+   if (JIT_MAX_BLOCKS == jit->blockCount || JIT_ARENA_SIZE - jit->used < JIT_MAX_BLOCK_BYTES) {
+      reset_jit(jit);
+   }
+   if (0 != mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE)) {
+      return NULL;
+   }
+
+   byte* code = jit->arena + jit->used;
+   struct Emitter e = { code, code + JIT_MAX_BLOCK_BYTES, false };
+   emit_prologue(&e);
+
+   //Consecutive OP_INTERP instructions are handed over in a single call.
+   uint32_t pc = start;
+   uint32_t callCount = 0;
+   word callPc = start;
+   struct ExitState state = { start, 0, 0, NO_REG };
+   //A block ends at $FFFF at the latest; the CPU then wraps to $0000.
+   while (state.insCount < JIT_MAX_INS && pc < MEM_MAX) {
+      byte opCode = ram->data[pc];
+      const struct OpInfo* info = &opInfo[opCode];
+      uint32_t next = pc + 1 + modeLen[info->mode];
+      if (OP_NONE == info->kind || next > MEM_MAX) {
+         break;
+      }
+      if (OP_INTERP != info->kind && 0 != callCount) {
+         emit_interp_call(&e, callPc, callCount, &state);
+         callCount = 0;
+      }
+
+      state.pc = (word)next;
+      state.cycles += info->cycles;
+      state.insCount++;
+      if (OP_INTERP == info->kind) {
+         callPc = (0 == callCount++) ? (word)pc : callPc;
+         if (CLI == opCode || PLP == opCode) {
+            emit_interp_call(&e, callPc, callCount, &state);
+            callCount = 0;
+         }
+      } else {
+         word operand = (word)(ram->data[(word)(pc + 1)] | (ram->data[(word)(pc + 2)] << 8));
+         state.znReg = emit_ins(&e, info, operand, &state);
+      }
+      pc = next;
+   }
+   if (0 != callCount) {
+      emit_interp_call(&e, callPc, callCount, &state);
+   }
+   emit_exit(&e, state.pc, state.cycles, state.insCount, state.znReg);
+
+   bool ok = 0 != state.insCount && !e.overflow;
+   if (0 != mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC) || !ok) {
+      return NULL;
+   }
+
+   struct JitBlock* blk = &jit->pool[jit->blockCount++];
+   blk->fn = (JitFn)(uintptr_t)code;
+   blk->start = start;
+   blk->end = pc;
+   blk->insCount = state.insCount;
+   blk->dead = false;
+   link_block(jit, ram, blk);
+   jit->used += ((size_t)(e.p - code) + 15) & ~(size_t)15;
+
+   return blk;
+}
+
+bool invalidate_jit(struct RAM* ram, word addr) {
+   struct Jit* jit = ram->jit;
+   byte page = addr >> 8;
+   bool hit = false;
+
+   for (struct JitBlock* blk = jit->pageBlocks[page]; NULL != blk; blk = blk->next[(blk->start >> 8) == page ? 0 : 1]) {
+      if (!blk->dead && blk->start <= addr && addr < blk->end) {
+         blk->dead = true;
+         jit->blocks[blk->start] = NULL;
+         jit->heat[blk->start] = 0;
+         hit = true;
+      }
+   }
+
+   jit->invalidated |= hit;
+   return hit;
+}
+
+//Counts entries into each PC (exec() start, or the instruction after a
+//block or an unsupported instruction) and compiles hot ones. Blocks only
+//run when the remaining instruction budget covers them whole; a cycle
+//deadline can be overshot by one block.
+int exec_jit(struct CPU* cpu, struct RAM* ram, uint32_t insCount, const uint64_t* deadline) {
+   struct Jit* jit = ram->jit;
+   bool entry = true;
+
+   if (STOP_NONE != cpu->stop) {
+      return 1;
+   }
+
+   while (insCount > 0 && (int64_t)(*deadline - cpu->cycles) > 0) {
+      word pc = cpu->pc;
+      struct JitBlock* blk = jit->blocks[pc];
+
+      if (NULL == blk && entry && JIT_COLD != jit->heat[pc] && ++jit->heat[pc] >= JIT_HOT_THRESHOLD) {
+         blk = compile_block(jit, ram, pc);
+         if (NULL == blk) {
+            jit->heat[pc] = JIT_COLD;
+         }
+      }
+
+      if (NULL != blk && blk->insCount <= insCount) {
+         insCount -= blk->fn(cpu, ram);
+         entry = true;
+         continue;
+      }
+
+      byte opCode = ram->data[pc];
+      if (0 != exec_interp(cpu, ram, 1)) {
+         return 1;
+      }
+      insCount--;
+      entry = OP_NONE == opInfo[opCode].kind;
+   }
+
+   return 0;
+}
+
+int init_jit(struct RAM* ram) {
+   if (NULL != ram->jit) {
+      return 0;
+   }
+
+   struct Jit* jit = calloc(1, sizeof(struct Jit));
+   if (NULL == jit) {
+      return 1;
+   }
+
+   jit->arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (MAP_FAILED == jit->arena) {
+      free(jit);
+      return 1;
+   }
+
+   ram->jit = jit;
+   return 0;
+}
+
+void free_jit(struct RAM* ram) {
+   if (NULL == ram->jit) {
+      return;
+   }
+
+   munmap(ram->jit->arena, JIT_ARENA_SIZE);
+   free(ram->jit);
+   ram->jit = NULL;
+}
+
+void flush_jit(struct RAM* ram) {
+   if (NULL != ram->jit) {
+      reset_jit(ram->jit);
+   }
+}
+
+#else
+
+int init_jit(struct RAM* ram) {
+   (void)ram;
+   return 1;
+}
+
+void free_jit(struct RAM* ram) {
+   (void)ram;
+}
+
+void flush_jit(struct RAM* ram) {
+   (void)ram;
+}
+
+int exec_jit(struct CPU* cpu, struct RAM* ram, uint32_t insCount, const uint64_t* deadline) {
+   (void)deadline;
+   return exec_interp(cpu, ram, insCount);
+}
+
+bool invalidate_jit(struct RAM* ram, word addr) {
+   (void)ram;
+   (void)addr;
+   return false;
+}
+
+#endif // __x86_64__ && __linux__
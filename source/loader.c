@@ -0,0 +1,364 @@
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE   //fstat/open with -std=c11
+#endif
+
+#include "../include/loader.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define LOADER_NO_MMAP
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#pragma region File access
+
+//Maps path read-only and private into img->map. Without mmap the file is
+//read into img->owned instead and img->map points at it.
+static int map_file(struct Image* img, const char* path) {
+#ifdef LOADER_NO_MMAP
+   FILE* file = fopen(path, "rb");
+   if (NULL == file) {
+      return 1;
+   }
+   fseek(file, 0, SEEK_END);
+   long size = ftell(file);
+   fseek(file, 0, SEEK_SET);
+   img->owned = malloc((size > 0) ? (size_t)size : 1);
+   if (size < 0 || NULL == img->owned || (size_t)size != fread(img->owned, 1, (size_t)size, file)) {
+      fclose(file);
+      return 1;
+   }
+   fclose(file);
+   img->map = img->owned;
+   img->mapSize = (size_t)size;
+   return 0;
+#else
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      return 1;
+   }
+
+   struct stat st;
+   if (0 != fstat(fd, &st) || 0 == st.st_size) {
+      close(fd);
+      return 1;
+   }
+
+   void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (MAP_FAILED == map) {
+      return 1;
+   }
+
+   img->map = map;
+   img->mapSize = (size_t)st.st_size;
+   return 0;
+#endif // LOADER_NO_MMAP
+}
+
+static void unmap_file(struct Image* img) {
+#ifndef LOADER_NO_MMAP
+   if (NULL != img->map) {
+      munmap(img->map, img->mapSize);
+   }
+#endif // !LOADER_NO_MMAP
+   img->map = NULL;
+   img->mapSize = 0;
+}
+
+#pragma endregion
+
+#pragma region Text formats
+
+static int hex_digit(char c) {
+   if (c >= '0' && c <= '9') {
+      return c - '0';
+   }
+   if (c >= 'A' && c <= 'F') {
+      return c - 'A' + 10;
+   }
+   if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+   }
+   return -1;
+}
+
+//Reads count hex byte pairs from text[*pos] on. Returns false on a bad digit
+//or the end of text.
+static bool read_hex_bytes(const char* text, size_t len, size_t* pos, byte* out, uint32_t count) {
+   for (uint32_t k = 0; k < count; k++) {
+      if (*pos + 2 > len) {
+         return false;
+      }
+      int hi = hex_digit(text[*pos]);
+      int lo = hex_digit(text[*pos + 1]);
+      if (hi < 0 || lo < 0) {
+         return false;
+      }
+      out[k] = (byte)((hi << 4) | lo);
+      *pos += 2;
+   }
+   return true;
+}
+
+//Collects the bytes of HEX/S-record data records into a 64 KiB buffer and
+//tracks the covered range.
+struct Collector {
+   byte* mem;
+   uint32_t low;
+   uint32_t high;   //One past the last byte.
+};
+
+static void collect(struct Collector* c, uint32_t addr, const byte* bytes, uint32_t count) {
+   for (uint32_t k = 0; k < count; k++) {
+      c->mem[(word)(addr + k)] = bytes[k];
+   }
+   if (0 == count) {
+      return;
+   }
+   if (addr < c->low) {
+      c->low = addr;
+   }
+   if (addr + count > c->high) {
+      c->high = (addr + count > MEM_MAX) ? MEM_MAX : addr + count;
+   }
+}
+
+//Intel HEX: ":LLAAAATT<data>CC" with a two's complement checksum.
+//Data (00) and end (01) records are used; address records above 64 KiB
+//are rejected.
+static int parse_ihex(const char* text, size_t len, struct Collector* c) {
+   size_t pos = 0;
+   while (pos < len) {
+      if (':' != text[pos]) {
+         pos++;
+         continue;
+      }
+      pos++;
+
+      byte head[4];
+      byte body[256];
+      if (!read_hex_bytes(text, len, &pos, head, 4) || !read_hex_bytes(text, len, &pos, body, head[0] + 1u)) {
+         return 1;
+      }
+
+      byte sum = 0;
+      for (uint32_t k = 0; k < 4; k++) {
+         sum += head[k];
+      }
+      for (uint32_t k = 0; k <= head[0]; k++) {
+         sum += body[k];
+      }
+      if (0 != sum) {
+         return 1;
+      }
+
+      switch (head[3]) {
+      case 0x00:
+         collect(c, (uint32_t)(head[1] << 8) | head[2], body, head[0]);
+         break;
+      case 0x01:
+         return 0;
+      case 0x02:
+      case 0x04:
+         if (0 != (body[0] | body[1])) {
+            return 1;
+         }
+         break;
+      default:
+         break;
+      }
+   }
+   return 0;
+}
+
+//S-record: "StLL<address><data>CC" with a one's complement checksum over
+//the count, address and data. S1/S2/S3 carry data; other types are skipped.
+static int parse_srec(const char* text, size_t len, struct Collector* c) {
+   static const byte addrLen[10] = { 2, 2, 3, 4, 0, 2, 3, 4, 3, 2 };
+   size_t pos = 0;
+   while (pos + 1 < len) {
+      if ('S' != text[pos] || text[pos + 1] < '0' || text[pos + 1] > '9') {
+         pos++;
+         continue;
+      }
+      int type = text[pos + 1] - '0';
+      pos += 2;
+
+      byte count;
+      byte body[256];
+      if (!read_hex_bytes(text, len, &pos, &count, 1) || count < addrLen[type] + 1 || !read_hex_bytes(text, len, &pos, body, count)) {
+         return 1;
+      }
+
+      byte sum = count;
+      for (uint32_t k = 0; k < count; k++) {
+         sum += body[k];
+      }
+      if (0xFF != sum) {
+         return 1;
+      }
+
+      if (type >= 1 && type <= 3) {
+         uint32_t addr = 0;
+         for (uint32_t k = 0; k < addrLen[type]; k++) {
+            addr = (addr << 8) | body[k];
+         }
+         if (addr >= MEM_MAX) {
+            return 1;
+         }
+         collect(c, addr, &body[addrLen[type]], count - addrLen[type] - 1);
+      }
+   }
+   return 0;
+}
+
+#pragma endregion
+
+static ImageFormat format_from_path(const char* path) {
+   const char* ext = strrchr(path, '.');
+   if (NULL == ext) {
+      return IMAGE_RAW;
+   }
+
+   static const struct {
+      const char* ext;
+      ImageFormat format;
+   } exts[] = {
+      { ".prg", IMAGE_PRG }, { ".PRG", IMAGE_PRG },
+      { ".hex", IMAGE_IHEX }, { ".HEX", IMAGE_IHEX }, { ".ihx", IMAGE_IHEX },
+      { ".s19", IMAGE_SREC }, { ".s28", IMAGE_SREC }, { ".srec", IMAGE_SREC }, { ".mot", IMAGE_SREC },
+   };
+   for (size_t k = 0; k < sizeof(exts) / sizeof(exts[0]); k++) {
+      if (0 == strcmp(ext, exts[k].ext)) {
+         return exts[k].format;
+      }
+   }
+   return IMAGE_RAW;
+}
+
+static int parse_text_image(struct Image* img, ImageFormat format) {
+   struct Collector c = { calloc(MEM_MAX, 1), MEM_MAX, 0 };
+   if (NULL == c.mem) {
+      printf_s("Allocation error");
+      return 1;
+   }
+
+   int res = (IMAGE_IHEX == format)
+      ? parse_ihex(img->map, img->mapSize, &c)
+      : parse_srec(img->map, img->mapSize, &c);
+   unmap_file(img);
+   free(img->owned);   //Only set without mmap, where it held the text.
+   img->owned = c.mem;
+
+   if (0 != res || c.high <= c.low) {
+      return 1;
+   }
+
+   img->origin = (word)c.low;
+   img->data = &c.mem[c.low];
+   img->size = c.high - c.low;
+   return 0;
+}
+
+int open_image(struct Image* img, const char* path, ImageFormat format, word origin) {
+   memset(img, 0, sizeof(struct Image));
+   if (0 != map_file(img, path)) {
+      printf_s("Cannot open image %s\n", path);
+      close_image(img);
+      return 1;
+   }
+
+   if (IMAGE_AUTO == format) {
+      format = format_from_path(path);
+   }
+
+   int res = 0;
+   const byte* bytes = img->map;
+   switch (format) {
+   case IMAGE_PRG:
+      if (img->mapSize <= 2) {
+         res = 1;
+         break;
+      }
+      img->origin = (word)(bytes[0] | (bytes[1] << 8));
+      img->data = &bytes[2];
+      img->size = (uint32_t)(img->mapSize - 2);
+      break;
+   case IMAGE_IHEX:
+   case IMAGE_SREC:
+      res = parse_text_image(img, format);
+      break;
+   default:
+      img->origin = origin;
+      img->data = bytes;
+      img->size = (uint32_t)img->mapSize;
+      break;
+   }
+
+   if (0 == res && img->size > (uint32_t)MEM_MAX - img->origin) {
+      img->size = (uint32_t)MEM_MAX - img->origin;
+   }
+   if (0 != res) {
+      printf_s("Malformed image %s\n", path);
+      close_image(img);
+      return 1;
+   }
+
+   //Past the end of a file mapping is unreadable, so a partial last page is
+   //served from a copy.
+   uint32_t whole = img->size & ~(PAGE_SIZE - 1);
+   memcpy(img->tail, &img->data[whole], img->size - whole);
+
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Opened image %s: %u bytes at [0x%X]\n", path, img->size, img->origin);
+#endif // _DEBUG
+
+   return 0;
+}
+
+void close_image(struct Image* img) {
+   unmap_file(img);
+   free(img->owned);
+   img->owned = NULL;
+   img->data = NULL;
+   img->size = 0;
+}
+
+int load_image(struct RAM* ram, const struct Image* img) {
+   if (NULL == img->data) {
+      return 1;
+   }
+   bus_write_block(ram, img->origin, img->data, img->size);
+   return 0;
+}
+
+int map_image(struct RAM* ram, const struct Image* img) {
+   if (NULL == img->data || 0 != (img->origin & (PAGE_SIZE - 1))) {
+      return 1;
+   }
+
+   byte first = img->origin >> 8;
+   uint32_t whole = img->size / PAGE_SIZE;
+   if (0 != whole && 0 != map_rom(ram, first, whole, img->data)) {
+      return 1;
+   }
+   if (0 != img->size % PAGE_SIZE) {
+      return map_rom(ram, (byte)(first + whole), 1, img->tail);
+   }
+   return 0;
+}
+
+int load_and_reset(struct CPU* cpu, struct RAM* ram, const struct Image* img, bool asRom) {
+   if (0 != (asRom ? map_image(ram, img) : load_image(ram, img))) {
+      return 1;
+   }
+
+   reset_cpu(cpu, (word)(bus_read(ram, 0xFFFC) | (bus_read(ram, 0xFFFD) << 8)));
+   return 0;
+}
@@ -0,0 +1,146 @@
+#include "../include/profile.h"
+#include <string.h>
+
+#define PROFILE_HASH_SIZE (2 * PROFILE_MAX_FRAMES)
+
+int init_profiler(struct RAM* ram) {
+   if (NULL != ram->profile) {
+      return 0;
+   }
+
+   ram->profile = malloc(sizeof(struct Profile));
+   if (NULL == ram->profile) {
+      printf_s("Allocation error");
+      return 1;
+   }
+   reset_profile(ram->profile);
+
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Initialized profiler\n");
+#endif // _DEBUG
+
+   return 0;
+}
+
+void free_profiler(struct RAM* ram) {
+   free(ram->profile);
+   ram->profile = NULL;
+}
+
+void reset_profile(struct Profile* prof) {
+   memset(prof, 0, sizeof(struct Profile));
+   prof->frameCount = 1;
+}
+
+//Call paths are looked up by (parent, entry) in an open-addressed table.
+//Calls that would need a frame past PROFILE_MAX_FRAMES, and calls made
+//under them, stay in the current frame and are only counted in lost.
+void profile_call(struct Profile* prof, word entry) {
+   if (0 != prof->lost) {
+      prof->lost++;
+      return;
+   }
+
+   uint32_t parent = prof->frame;
+   uint32_t h = ((parent * 0x9E3779B1u) ^ entry) & (PROFILE_HASH_SIZE - 1);
+   for (;;) {
+      uint32_t k = prof->children[h];
+      if (0 == k) {
+         break;
+      }
+      if (prof->frames[k].parent == parent && prof->frames[k].entry == entry) {
+         prof->frames[k].calls++;
+         prof->frame = k;
+         return;
+      }
+      h = (h + 1) & (PROFILE_HASH_SIZE - 1);
+   }
+
+   if (PROFILE_MAX_FRAMES == prof->frameCount) {
+      prof->lost++;
+      return;
+   }
+
+   uint32_t k = prof->frameCount++;
+   prof->frames[k].entry = entry;
+   prof->frames[k].parent = (uint16_t)parent;
+   prof->frames[k].calls = 1;
+   prof->children[h] = (uint16_t)k;
+   prof->frame = k;
+}
+
+void write_profile_json(const struct Profile* prof, FILE* file) {
+   uint64_t insTotal = 0;
+   uint64_t cyclesTotal = 0;
+   for (uint32_t op = 0; op < 256; op++) {
+      insTotal += prof->opCount[op];
+      cyclesTotal += prof->opCycles[op];
+   }
+
+   fprintf(file, "{\"instructions\":%llu,\"cycles\":%llu,\n\"opcodes\":[",
+      (unsigned long long)insTotal, (unsigned long long)cyclesTotal);
+   const char* sep = "";
+   for (uint32_t op = 0; op < 256; op++) {
+      if (0 != prof->opCount[op]) {
+         fprintf(file, "%s\n{\"opcode\":%u,\"count\":%llu,\"cycles\":%llu}", sep, op,
+            (unsigned long long)prof->opCount[op], (unsigned long long)prof->opCycles[op]);
+         sep = ",";
+      }
+   }
+
+   fprintf(file, "],\n\"pcs\":[");
+   sep = "";
+   for (uint32_t pc = 0; pc < MEM_MAX; pc++) {
+      if (0 != prof->pcCycles[pc]) {
+         fprintf(file, "%s\n{\"pc\":%u,\"cycles\":%llu}", sep, pc, (unsigned long long)prof->pcCycles[pc]);
+         sep = ",";
+      }
+   }
+
+   fprintf(file, "],\n\"fusion\":[");
+   sep = "";
+   for (uint32_t k = FUSE_NONE + 1; k < FUSE_COUNT; k++) {
+      if (0 != prof->fused[k]) {
+         fprintf(file, "%s\n{\"run\":\"%s\",\"count\":%llu,\"saved\":%llu}", sep, fuseInfo[k].name,
+            (unsigned long long)prof->fused[k], (unsigned long long)prof->fused[k] * (fuseInfo[k].insCount - 1));
+         sep = ",";
+      }
+   }
+
+   fprintf(file, "],\n\"frames\":[");
+   for (uint32_t k = 0; k < prof->frameCount; k++) {
+      const struct ProfileFrame* f = &prof->frames[k];
+      fprintf(file, "%s\n{\"id\":%u,\"parent\":%u,\"entry\":%u,\"calls\":%llu,\"cycles\":%llu}", (0 == k) ? "" : ",",
+         k, f->parent, f->entry, (unsigned long long)f->calls, (unsigned long long)f->cycles);
+   }
+   fprintf(file, "]}\n");
+}
+
+uint64_t profile_fused_saving(const struct Profile* prof) {
+   uint64_t saved = 0;
+   for (uint32_t k = FUSE_NONE + 1; k < FUSE_COUNT; k++) {
+      saved += prof->fused[k] * (fuseInfo[k].insCount - 1);
+   }
+   return saved;
+}
+
+void write_profile_collapsed(const struct Profile* prof, FILE* file) {
+   uint16_t path[PROFILE_MAX_FRAMES];
+   for (uint32_t k = 0; k < prof->frameCount; k++) {
+      if (0 == prof->frames[k].cycles) {
+         continue;
+      }
+
+      //Parents always have lower indices, so the walk ends at the root.
+      uint32_t depth = 0;
+      for (uint32_t f = k; 0 != f; f = prof->frames[f].parent) {
+         path[depth++] = (uint16_t)f;
+      }
+
+      fprintf(file, "root");
+      while (0 != depth) {
+         fprintf(file, ";sub_%04X", prof->frames[path[--depth]].entry);
+      }
+      fprintf(file, " %llu\n", (unsigned long long)prof->frames[k].cycles);
+   }
+}
@@ -0,0 +1,113 @@
+#include "../include/rewind.h"
+#include <stdio.h>
+
+struct Rewind* init_rewind(uint64_t interval, size_t budget) {
+   struct Rewind* rw = calloc(1, sizeof(struct Rewind));
+   if (NULL == rw) {
+      printf_s("Allocation error");
+      return NULL;
+   }
+   rw->interval = interval;
+   rw->budget = budget;
+
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Initialized rewind buffer\n");
+#endif // _DEBUG
+
+   return rw;
+}
+
+static struct Keyframe* keyframe_at(struct Rewind* rw, uint32_t k) {
+   return &rw->frames[(rw->head + k) % REWIND_MAX_KEYFRAMES];
+}
+
+static void drop_newest(struct Rewind* rw) {
+   struct Keyframe* newest = keyframe_at(rw, rw->count - 1);
+   rw->used -= newest->size;
+   free_snapshot(newest->snap);
+   rw->count--;
+}
+
+//The pages the oldest keyframe shared with the next one stay allocated, so
+//they count to that one from now on.
+static void drop_oldest(struct Rewind* rw) {
+   struct Keyframe* oldest = keyframe_at(rw, 0);
+   rw->used -= oldest->size;
+   free_snapshot(oldest->snap);
+   rw->head = (rw->head + 1) % REWIND_MAX_KEYFRAMES;
+   rw->count--;
+
+   if (0 != rw->count) {
+      struct Keyframe* next = keyframe_at(rw, 0);
+      rw->used -= next->size;
+      next->size = snapshot_delta_size(next->snap, NULL);
+      rw->used += next->size;
+   }
+}
+
+void free_rewind(struct Rewind* rw) {
+   if (NULL == rw) {
+      return;
+   }
+
+   while (0 != rw->count) {
+      drop_newest(rw);
+   }
+   free(rw);
+}
+
+int rewind_record(struct Rewind* rw, struct RAM* ram, const struct CPU* cpu) {
+   if (0 != rw->count && cpu->cycles - keyframe_at(rw, rw->count - 1)->cycle < rw->interval) {
+      return 0;
+   }
+
+   struct Snapshot* snap = take_snapshot(ram, cpu);
+   if (NULL == snap) {
+      return 1;
+   }
+   if (REWIND_MAX_KEYFRAMES == rw->count) {
+      drop_oldest(rw);
+   }
+
+   const struct Snapshot* prev = (0 != rw->count) ? keyframe_at(rw, rw->count - 1)->snap : NULL;
+   struct Keyframe* kf = keyframe_at(rw, rw->count++);
+   kf->snap = snap;
+   kf->cycle = cpu->cycles;
+   kf->size = snapshot_delta_size(snap, prev);
+   rw->used += kf->size;
+
+   //The newest keyframe stays even if it alone is over budget.
+   while (rw->used > rw->budget && 1 < rw->count) {
+      drop_oldest(rw);
+   }
+
+   return 0;
+}
+
+int rewind_seek(struct Rewind* rw, struct RAM* ram, struct CPU* cpu, uint64_t cycle) {
+   //Keyframes are in cycle order: find the first one past cycle.
+   uint32_t lo = 0;
+   uint32_t hi = rw->count;
+   while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (keyframe_at(rw, mid)->cycle <= cycle) {
+         lo = mid + 1;
+      }
+      else {
+         hi = mid;
+      }
+   }
+   if (0 == lo) {
+      return 1;
+   }
+
+   while (rw->count > lo) {
+      drop_newest(rw);
+   }
+   restore_snapshot(ram, cpu, keyframe_at(rw, lo - 1)->snap);
+   if (cycle > cpu->cycles) {
+      exec_cycles(cpu, ram, (int64_t)(cycle - cpu->cycles));
+   }
+
+   return 0;
+}
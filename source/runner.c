@@ -0,0 +1,233 @@
+#include "../include/runner.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+//Chase-Lev deque of job indices. The owner pops from the bottom, other
+//workers steal from the top; only the last item needs a CAS. Jobs never
+//spawn jobs, so the deque is filled before the workers start and never grows.
+struct Deque {
+   _Alignas(64) atomic_llong top;
+   _Alignas(64) atomic_llong bottom;
+   uint32_t* items;
+};
+
+typedef enum {
+   STEAL_OK,
+   STEAL_EMPTY,
+   STEAL_LOST   //Another worker took the item first; worth retrying.
+} StealResult;
+
+struct Worker {
+   struct Runner* runner;
+   uint32_t id;
+   struct RAM* ram;   //Arena reused for every job this worker runs.
+   struct Deque deque;
+   thrd_t thread;
+};
+
+struct Runner {
+   uint32_t workerCount;
+   struct Worker* workers;
+   const struct Job* jobs;
+   struct JobResult* results;
+};
+
+#pragma region Deque
+
+static bool pop_job(struct Deque* d, uint32_t* job) {
+   long long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+   atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+   atomic_thread_fence(memory_order_seq_cst);
+   long long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+   if (t > b) {
+      atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+      return false;
+   }
+
+   *job = d->items[b];
+   if (t < b) {
+      return true;
+   }
+
+   //Last item: race the thieves for it.
+   bool won = atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+   atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+   return won;
+}
+
+static StealResult steal_job(struct Deque* d, uint32_t* job) {
+   long long t = atomic_load_explicit(&d->top, memory_order_acquire);
+   atomic_thread_fence(memory_order_seq_cst);
+   long long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+   if (t >= b) {
+      return STEAL_EMPTY;
+   }
+
+   *job = d->items[t];
+   if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+      return STEAL_LOST;
+   }
+   return STEAL_OK;
+}
+
+#pragma endregion
+
+static void run_job(struct Worker* w, const struct Job* job, struct JobResult* res) {
+   byte* mem = w->ram->data;
+   uint32_t size = job->imageSize;
+   if (size > (uint32_t)MEM_MAX - job->origin) {
+      size = (uint32_t)MEM_MAX - job->origin;
+   }
+
+   memset(mem, 0, MEM_MAX);
+   memcpy(&mem[job->origin], job->image, size);
+
+   res->cpu = job->state;
+   if (0 != job->cycleBudget) {
+      exec_cycles(&res->cpu, w->ram, job->cycleBudget);
+   }
+   else {
+      exec(&res->cpu, w->ram, job->insBudget);
+   }
+   //Not the return value: exec_cycles() can stop on the instruction that
+   //crosses the deadline.
+   res->stop = (STOP_NONE != res->cpu.stop) ? RUN_STOPPED : RUN_BUDGET;
+   res->worker = w->id;
+}
+
+//Tries every other worker once, starting after self. Returns false once
+//all deques are empty, which is final since no jobs are added mid-run.
+static bool steal_any(struct Worker* w, uint32_t* job) {
+   struct Runner* r = w->runner;
+
+   for (;;) {
+      bool lost = false;
+      for (uint32_t k = 1; k < r->workerCount; k++) {
+         struct Worker* victim = &r->workers[(w->id + k) % r->workerCount];
+         StealResult res = steal_job(&victim->deque, job);
+         if (STEAL_OK == res) {
+            return true;
+         }
+         lost |= (STEAL_LOST == res);
+      }
+      if (!lost) {
+         return false;
+      }
+   }
+}
+
+static int worker_main(void* arg) {
+   struct Worker* w = arg;
+   struct Runner* r = w->runner;
+   uint32_t job;
+
+   while (pop_job(&w->deque, &job) || steal_any(w, &job)) {
+      run_job(w, &r->jobs[job], &r->results[job]);
+   }
+
+   return 0;
+}
+
+struct Runner* init_runner(uint32_t workerCount) {
+   if (0 == workerCount) {
+      return NULL;
+   }
+
+   struct Runner* r = calloc(1, sizeof(struct Runner));
+   if (NULL == r) {
+      printf_s("Allocation error");
+      return NULL;
+   }
+
+   r->workers = calloc(workerCount, sizeof(struct Worker));
+   if (NULL == r->workers) {
+      printf_s("Allocation error");
+      free(r);
+      return NULL;
+   }
+   r->workerCount = workerCount;
+
+   for (uint32_t k = 0; k < workerCount; k++) {
+      r->workers[k].runner = r;
+      r->workers[k].id = k;
+      r->workers[k].ram = init_ram();
+      if (NULL == r->workers[k].ram) {
+         free_runner(r);
+         return NULL;
+      }
+   }
+
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Initialized runner with %u workers\n", workerCount);
+#endif // _DEBUG
+
+   return r;
+}
+
+void free_runner(struct Runner* runner) {
+   if (NULL == runner) {
+      return;
+   }
+
+   for (uint32_t k = 0; k < runner->workerCount; k++) {
+      if (NULL != runner->workers[k].ram) {
+         free_ram(runner->workers[k].ram);
+      }
+   }
+   free(runner->workers);
+   free(runner);
+}
+
+int run_jobs(struct Runner* runner, const struct Job* jobs, struct JobResult* results, uint32_t jobCount) {
+   uint32_t workerCount = runner->workerCount;
+   uint32_t* items = malloc(((size_t)jobCount + 1) * sizeof(uint32_t));
+   if (NULL == items) {
+      printf_s("Allocation error");
+      return 1;
+   }
+
+   runner->jobs = jobs;
+   runner->results = results;
+
+   //Deal jobs round-robin so neighbouring (often similar) jobs start on
+   //different workers; stealing evens out the rest.
+   uint32_t next = 0;
+   for (uint32_t k = 0; k < workerCount; k++) {
+      struct Deque* d = &runner->workers[k].deque;
+      d->items = &items[next];
+      long long count = 0;
+      for (uint32_t j = k; j < jobCount; j += workerCount) {
+         d->items[count++] = j;
+      }
+      next += (uint32_t)count;
+      atomic_init(&d->top, 0);
+      atomic_init(&d->bottom, count);
+   }
+
+   uint32_t started = 0;
+   for (; started < workerCount; started++) {
+      struct Worker* w = &runner->workers[started];
+      if (thrd_success != thrd_create(&w->thread, worker_main, w)) {
+         printf_s("Thread creation error");
+         break;
+      }
+   }
+
+   //If some threads failed to start, the running ones steal their jobs.
+   if (0 == started) {
+      free(items);
+      return 1;
+   }
+
+   for (uint32_t k = 0; k < started; k++) {
+      thrd_join(runner->workers[k].thread, NULL);
+   }
+
+   free(items);
+   return 0;
+}
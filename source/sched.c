@@ -0,0 +1,115 @@
+#include "../include/sched.h"
+#include <stdio.h>
+
+int init_scheduler(struct RAM* ram) {
+   if (NULL != ram->sched) {
+      return 0;
+   }
+
+   ram->sched = calloc(1, sizeof(struct Scheduler));
+   if (NULL == ram->sched) {
+      printf_s("Allocation error");
+      return 1;
+   }
+
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Initialized scheduler\n");
+#endif // _DEBUG
+
+   return 0;
+}
+
+void free_scheduler(struct RAM* ram) {
+   free(ram->sched);
+   ram->sched = NULL;
+}
+
+static bool event_before(const struct Event* lhs, const struct Event* rhs) {
+   return (lhs->cycle != rhs->cycle) ? lhs->cycle < rhs->cycle : (int32_t)(lhs->seq - rhs->seq) < 0;
+}
+
+static void sift_up(struct Scheduler* sched, uint32_t k) {
+   struct Event ev = sched->heap[k];
+   while (0 != k && event_before(&ev, &sched->heap[(k - 1) / 2])) {
+      sched->heap[k] = sched->heap[(k - 1) / 2];
+      k = (k - 1) / 2;
+   }
+   sched->heap[k] = ev;
+}
+
+static void sift_down(struct Scheduler* sched, uint32_t k) {
+   struct Event ev = sched->heap[k];
+   for (;;) {
+      uint32_t child = 2 * k + 1;
+      if (child >= sched->count) {
+         break;
+      }
+      if (child + 1 < sched->count && event_before(&sched->heap[child + 1], &sched->heap[child])) {
+         child++;
+      }
+      if (!event_before(&sched->heap[child], &ev)) {
+         break;
+      }
+      sched->heap[k] = sched->heap[child];
+      k = child;
+   }
+   sched->heap[k] = ev;
+}
+
+int schedule_event(struct RAM* ram, uint64_t cycle, EventFn fn, void* ctx) {
+   struct Scheduler* sched = ram->sched;
+   if (SCHED_MAX_EVENTS == sched->count) {
+      return 1;
+   }
+
+   sched->heap[sched->count] = (struct Event){ .cycle = cycle, .seq = sched->seq++, .fn = fn, .ctx = ctx };
+   sift_up(sched, sched->count++);
+   if (cycle < sched->limit) {
+      sched->limit = cycle;
+   }
+   return 0;
+}
+
+void cancel_events(struct RAM* ram, EventFn fn, void* ctx) {
+   struct Scheduler* sched = ram->sched;
+   uint32_t kept = 0;
+   for (uint32_t k = 0; k < sched->count; k++) {
+      if (sched->heap[k].fn != fn || sched->heap[k].ctx != ctx) {
+         sched->heap[kept++] = sched->heap[k];
+      }
+   }
+
+   sched->count = kept;
+   for (uint32_t k = kept / 2; k-- > 0;) {
+      sift_down(sched, k);
+   }
+}
+
+//Asserting a line mid-run ends the run after the current instruction.
+void set_irq(struct RAM* ram, uint32_t source, bool asserted) {
+   struct Scheduler* sched = ram->sched;
+   if (asserted) {
+      sched->irq |= source;
+      sched->limit = 0;
+   }
+   else {
+      sched->irq &= ~source;
+   }
+}
+
+void trigger_nmi(struct RAM* ram) {
+   ram->sched->nmi = true;
+   ram->sched->limit = 0;
+}
+
+uint64_t run_due_events(struct RAM* ram, uint64_t cycle) {
+   struct Scheduler* sched = ram->sched;
+   while (0 != sched->count && sched->heap[0].cycle <= cycle) {
+      struct Event ev = sched->heap[0];
+      sched->heap[0] = sched->heap[--sched->count];
+      sift_down(sched, 0);
+      ev.fn(ev.ctx, ram, ev.cycle);
+   }
+
+   return (0 != sched->count) ? sched->heap[0].cycle : UINT64_MAX;
+}
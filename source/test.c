@@ -1,5 +1,14 @@
 #include "../include/test.h"
+#include "../include/jit.h"
+#include "../include/loader.h"
+#include "../include/optable.h"
+#include "../include/profile.h"
+#include "../include/rewind.h"
+#include "../include/runner.h"
+#include "../include/sched.h"
+#include "../include/trace.h"
 #include <stdlib.h>
+#include <string.h>
 
 static void test_reset_cpu(void) {
    PRINT_TEST_NAME();
@@ -8,14 +17,14 @@ static void test_reset_cpu(void) {
    reset_cpu(&cpu, 0xFFFC);
 
    ASSERT_EQUAL(0xFFFC, cpu.pc, "PC");
-   ASSERT_EQUAL(0x01FF, cpu.sp, "SP");
-   ASSERT_EQUAL(0, cpu.c, "C");
-   ASSERT_EQUAL(0, cpu.z, "Z");
-   ASSERT_EQUAL(0, cpu.i, "I");
-   ASSERT_EQUAL(0, cpu.d, "D");
-   ASSERT_EQUAL(0, cpu.b, "B");
-   ASSERT_EQUAL(0, cpu.v, "V");
-   ASSERT_EQUAL(0, cpu.n, "N");
+   ASSERT_EQUAL(0x01FF, get_sp(&cpu), "SP");
+   ASSERT_EQUAL(0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(0, cpu.a, "A");
    ASSERT_EQUAL(0, cpu.x, "X");
    ASSERT_EQUAL(0, cpu.y, "Y");
@@ -23,6 +32,32 @@ static void test_reset_cpu(void) {
    free_ram(ram);
 }
 
+static void test_flag_accessors(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   reset_cpu(&cpu, 0xFFFC);
+
+   set_flag(&cpu, FLAG_Z, 1);
+   set_flag(&cpu, FLAG_N, 1);
+   set_flag(&cpu, FLAG_D, 1);
+   ASSERT_EQUAL(0x8A, get_ps(&cpu), "PS");
+
+   set_flag(&cpu, FLAG_Z, 0);
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_N), "N");
+
+   set_ps(&cpu, 0x43);
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x43, get_ps(&cpu), "PS");
+
+   set_sp(&cpu, 0x01A0);
+   ASSERT_EQUAL(0x01A0, get_sp(&cpu), "SP");
+   ASSERT_EQUAL(0xA0, cpu.sp, "SP offset");
+}
+
 static void test_jsr(void) {
    PRINT_TEST_NAME();
    struct CPU cpu;
@@ -77,8 +112,8 @@ static void test_lda_imm(void) {
    ASSERT_EQUAL(0x42, cpu.a, "A");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(2, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -97,8 +132,8 @@ static void test_lda_zp(void) {
    ASSERT_EQUAL(0x24, cpu.a, "A");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(3, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -118,8 +153,8 @@ static void test_lda_zp_x(void) {
    ASSERT_EQUAL(0x70, cpu.a, "A");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -139,8 +174,8 @@ static void test_lda_abs(void) {
    ASSERT_EQUAL(0x15, cpu.a, "A");
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -160,8 +195,8 @@ static void test_lda_abs_x(void) {
    ASSERT_EQUAL(0x15, cpu.a, "A");
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -181,8 +216,8 @@ static void test_lda_abs_y(void) {
    ASSERT_EQUAL(0x15, cpu.a, "A");
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -203,8 +238,8 @@ static void test_lda_ind_x(void) {
    ASSERT_EQUAL(0x51, cpu.a, "A");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(6, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -226,8 +261,8 @@ static void test_lda_ind_y(void) {
    ASSERT_EQUAL(0x51, cpu.a, "A");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(5, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -245,8 +280,8 @@ static void test_ldx_imm(void) {
    ASSERT_EQUAL(0x42, cpu.x, "X");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(2, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -264,8 +299,8 @@ static void test_ldx_zp(void) {
    ASSERT_EQUAL(0x24, cpu.x, "X");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(3, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 } 
@@ -284,8 +319,8 @@ static void test_ldx_zp_y(void) {
    ASSERT_EQUAL(0x24, cpu.x, "X");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -304,8 +339,8 @@ static void test_ldx_abs(void) {
    ASSERT_EQUAL(0x15, cpu.x, "X");
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -326,8 +361,8 @@ static void test_ldx_abs_y(void) {
    ASSERT_EQUAL(0x15, cpu.x, "X");
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -345,8 +380,8 @@ static void test_ldy_imm(void) {
    ASSERT_EQUAL(0x42, cpu.y, "Y");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(2, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -365,8 +400,8 @@ static void test_ldy_zp(void) {
    ASSERT_EQUAL(0x24, cpu.y, "Y");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(3, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
   
    free_ram(ram);
 }
@@ -386,8 +421,8 @@ static void test_ldy_zp_x(void) {
    ASSERT_EQUAL(0x24, cpu.y, "Y");
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -407,8 +442,8 @@ static void test_ldy_abs(void) {
    ASSERT_EQUAL(0x15, cpu.y, "Y");
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -429,8 +464,8 @@ static void test_ldy_abs_x(void) {
    ASSERT_EQUAL(0x15, cpu.y, "Y");
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
 
    free_ram(ram);
 }
@@ -748,13 +783,13 @@ static void test_tya(void) {
 
    ASSERT_EQUAL(cpu.y, cpu.a, "A");
    ASSERT_EQUAL(0xFFFD, cpu.pc, "PC");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x1, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(2, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -766,19 +801,19 @@ static void test_tsx(void) {
    reset_cpu(&cpu, 0xFFFC);
    struct RAM* ram = init_ram();
 
-   cpu.sp = 0x42;
+   set_sp(&cpu, 0x42);
    ram->data[0xFFFC] = TSX;
    exec(&cpu, ram, 1);
 
    ASSERT_EQUAL(0x42, cpu.x, "X");
    ASSERT_EQUAL(0xFFFD, cpu.pc, "PC");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(2, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -796,13 +831,13 @@ static void test_txs(void) {
 
    ASSERT_EQUAL(0x42, cpu.x, "X");
    ASSERT_EQUAL(0xFFFD, cpu.pc, "PC");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(2, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -819,15 +854,15 @@ static void test_pha(void) {
  
    exec(&cpu, ram, 1);
 
-   ASSERT_EQUAL(0x01FE, cpu.sp, "SP");
+   ASSERT_EQUAL(0x01FE, get_sp(&cpu), "SP");
    ASSERT_EQUAL(0xFFFD, cpu.pc, "PC");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(3, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -844,16 +879,16 @@ static void test_php(void) {
    ram->data[0xFFFE] = PHP;
    exec(&cpu, ram, 2);
    
-   ASSERT_EQUAL(0x01FE, cpu.sp, "SP");
+   ASSERT_EQUAL(0x01FE, get_sp(&cpu), "SP");
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
-   ASSERT_EQUAL(0x80, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x1, cpu.n, "N");
+   ASSERT_EQUAL(0x80, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(5, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -865,21 +900,21 @@ static void test_pla(void) {
    reset_cpu(&cpu, 0xFFFC);
    struct RAM* ram = init_ram();
    
-   cpu.sp = 0x01FE;
+   set_sp(&cpu, 0x01FE);
    ram->data[0x01FE] = 0x42;
    ram->data[0xFFFC] = PLA;
    exec(&cpu, ram, 1);
 
-   ASSERT_EQUAL(0x01FF, cpu.sp, "SP");
+   ASSERT_EQUAL(0x01FF, get_sp(&cpu), "SP");
    ASSERT_EQUAL(0xFFFD, cpu.pc, "PC");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -891,26 +926,67 @@ static void test_plp(void) {
    reset_cpu(&cpu, 0xFFFC);
    struct RAM* ram = init_ram();
 
-   cpu.sp = 0x01FE;
+   set_sp(&cpu, 0x01FE);
    ram->data[0x01FE] = 0x81;
    ram->data[0xFFFC] = PLP;
    exec(&cpu, ram, 1);
 
-   ASSERT_EQUAL(0x01FF, cpu.sp, "SP");
+   ASSERT_EQUAL(0x01FF, get_sp(&cpu), "SP");
    ASSERT_EQUAL(0xFFFD, cpu.pc, "PC");
-   ASSERT_EQUAL(0x81, cpu.ps, "PS");
-   ASSERT_EQUAL(0x1, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x1, cpu.n, "N");
+   ASSERT_EQUAL(0x81, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
 }
 
+static void test_php_lazy_flags(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   reset_cpu(&cpu, 0xFFFC);
+   struct RAM* ram = init_ram();
+
+   ram->data[0xFFFC] = LDA_IM;
+   ram->data[0xFFFD] = 0x00;
+   ram->data[0xFFFE] = PHP;
+   exec(&cpu, ram, 2);
+
+   ASSERT_EQUAL(0x02, ram->data[0x01FE], "Pushed PS");
+   ASSERT_EQUAL(0x02, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+
+   free_ram(ram);
+}
+
+static void test_plp_php_roundtrip(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   reset_cpu(&cpu, 0xFFFC);
+   struct RAM* ram = init_ram();
+
+   set_sp(&cpu, 0x01FE);
+   ram->data[0x01FE] = 0xC3;
+   ram->data[0xFFFC] = PLP;
+   ram->data[0xFFFD] = PHP;
+   exec(&cpu, ram, 2);
+
+   ASSERT_EQUAL(0xC3, ram->data[0x01FE], "Pushed PS");
+   ASSERT_EQUAL(0xC3, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_N), "N");
+
+   free_ram(ram);
+}
+
 static void test_and_imm(void) {
    PRINT_TEST_NAME();
    struct CPU cpu;
@@ -924,14 +1000,14 @@ static void test_and_imm(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x0, cpu.a, "A");
-   ASSERT_EQUAL(0x2, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x1, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x2, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(2, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -951,14 +1027,14 @@ static void test_and_zp(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x0, cpu.a, "A");
-   ASSERT_EQUAL(0x2, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x1, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x2, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(3, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -979,14 +1055,14 @@ static void test_and_zp_x(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x0, cpu.a, "A");
-   ASSERT_EQUAL(0x2, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x1, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x2, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1007,14 +1083,14 @@ static void test_and_abs(void) {
 
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(0x0, cpu.a, "A");
-   ASSERT_EQUAL(0x2, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x1, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x2, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1036,14 +1112,14 @@ static void test_and_abs_x(void) {
 
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(0x0, cpu.a, "A");
-   ASSERT_EQUAL(0x2, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x1, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x2, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1065,14 +1141,14 @@ static void test_and_abs_y(void) {
 
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(0x0, cpu.a, "A");
-   ASSERT_EQUAL(0x2, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x1, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x2, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1095,14 +1171,14 @@ static void test_and_ind_x(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x0, cpu.a, "A");
-   ASSERT_EQUAL(0x2, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x1, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x2, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(6, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1125,14 +1201,14 @@ static void test_and_ind_y(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x0, cpu.a, "A");
-   ASSERT_EQUAL(0x2, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x1, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x2, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(5, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1151,14 +1227,14 @@ static void test_eor_imm(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x66, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(2, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1178,14 +1254,14 @@ static void test_eor_zp(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x66, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(3, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1206,14 +1282,14 @@ static void test_eor_zp_x(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x66, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1234,14 +1310,14 @@ static void test_eor_abs(void) {
 
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(0x66, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1263,14 +1339,14 @@ static void test_eor_abs_x(void) {
 
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(0x66, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1292,14 +1368,14 @@ static void test_eor_abs_y(void) {
 
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(0x66, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1322,14 +1398,14 @@ static void test_eor_ind_x(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x66, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(6, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1352,14 +1428,14 @@ static void test_eor_ind_y(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x66, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(5, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1378,14 +1454,14 @@ static void test_ora_imm(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x75, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(2, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1405,14 +1481,14 @@ static void test_ora_zp(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x75, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(3, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1433,14 +1509,14 @@ static void test_ora_zp_x(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x75, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1461,14 +1537,14 @@ static void test_ora_abs(void) {
 
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(0x75, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1490,14 +1566,14 @@ static void test_ora_abs_x(void) {
 
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(0x75, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1519,14 +1595,14 @@ static void test_ora_abs_y(void) {
 
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(0x75, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1549,14 +1625,14 @@ static void test_ora_ind_x(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x57, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(6, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1579,14 +1655,14 @@ static void test_ora_ind_y(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0x57, cpu.a, "A");
-   ASSERT_EQUAL(0x0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x0, cpu.n, "N");
+   ASSERT_EQUAL(0x0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(5, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1606,14 +1682,14 @@ static void test_bit_zp(void) {
 
    ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
    ASSERT_EQUAL(0xFF, cpu.a, "A");
-   ASSERT_EQUAL(0xC0, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x1, cpu.v, "V");
-   ASSERT_EQUAL(0x1, cpu.n, "N");
+   ASSERT_EQUAL(0xC0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(3, cpu.cycles, "Cycles");
 
    free_ram(ram);
@@ -1634,21 +1710,1333 @@ static void test_bit_abs(void) {
 
    ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
    ASSERT_EQUAL(0xA5, cpu.a, "A");
-   ASSERT_EQUAL(0x80, cpu.ps, "PS");
-   ASSERT_EQUAL(0x0, cpu.c, "C");
-   ASSERT_EQUAL(0x0, cpu.z, "Z");
-   ASSERT_EQUAL(0x0, cpu.i, "I");
-   ASSERT_EQUAL(0x0, cpu.d, "D");
-   ASSERT_EQUAL(0x0, cpu.b, "B");
-   ASSERT_EQUAL(0x0, cpu.v, "V");
-   ASSERT_EQUAL(0x1, cpu.n, "N");
+   ASSERT_EQUAL(0xC0, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_I), "I");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_D), "D");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_B), "B");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_N), "N");
    ASSERT_EQUAL(4, cpu.cycles, "Cycles");
 
    free_ram(ram);
 }
 
+//A & M is 0, but N and V still come from M.
+static void test_bit_flags_from_operand(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   reset_cpu(&cpu, 0xFFFC);
+
+   cpu.a = 0x0F;
+   ram->data[0x0041] = 0xC0;
+   ram->data[0xFFFC] = BIT_ZP;
+   ram->data[0xFFFD] = 0x41;
+   exec(&cpu, ram, 1);
+
+   ASSERT_EQUAL(0x0F, cpu.a, "A");
+   ASSERT_EQUAL(0xC2, get_ps(&cpu), "PS");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_V), "V");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_N), "N");
+
+   free_ram(ram);
+}
+
+static void test_adc_abs_x(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   reset_cpu(&cpu, 0xFFFC);
+
+   cpu.a = 0x10;
+   cpu.x = 0xC0;
+   cpu.c = 1;
+   ram->data[0xFFFC] = ADC_ABSX;
+   ram->data[0xFFFD] = 0x41;
+   ram->data[0xFFFE] = 0x51;
+   ram->data[0x5201] = 0x20;
+   exec(&cpu, ram, 1);
+
+   ASSERT_EQUAL(0xFFFF, cpu.pc, "PC");
+   ASSERT_EQUAL(0x31, cpu.a, "A");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_C), "C");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_N), "N");
+   ASSERT_EQUAL(5, cpu.cycles, "Cycles");
+
+   free_ram(ram);
+}
+
+static void test_full_opcode_set(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   reset_cpu(&cpu, 0x0200);
+
+   //Counts to 3 in a loop, checks the count, then BRKs to a handler that
+   //returns to a JAM.
+   static const byte prog[] = {
+      LDX_IM, 0x03,
+      INC_ZP, 0x10,
+      DEX,
+      BNE, 0xFB,
+      LDA_ZP, 0x10,
+      CMP_IM, 0x03,
+      BEQ, 0x03,
+      JMP_ABS, 0x00, 0x00,
+      SEC,
+      SBC_IM, 0x01,
+      BRK, 0x00,
+      JAM
+   };
+   static const byte handler[] = { ROL_ACC, RTI };
+   memcpy(&ram->data[0x0200], prog, sizeof(prog));
+   memcpy(&ram->data[0x0300], handler, sizeof(handler));
+   ram->data[0xFFFE] = 0x00;
+   ram->data[0xFFFF] = 0x03;
+   byte ps = get_ps(&cpu);
+   word sp = get_sp(&cpu);
+
+   ASSERT_EQUAL(1, exec(&cpu, ram, 100), "Stopped");
+   ASSERT_EQUAL(STOP_JAM, cpu.stop, "Stop reason");
+   ASSERT_EQUAL(0x0216, cpu.pc, "PC");
+   ASSERT_EQUAL(3, ram->data[0x0010], "Counter");
+   ASSERT_EQUAL(0x05, cpu.a, "A");
+   ASSERT_EQUAL(0x00, cpu.x, "X");
+   ASSERT_EQUAL(sp, get_sp(&cpu), "SP");
+   ASSERT_EQUAL(0x1, get_flag(&cpu, FLAG_C), "C from before BRK");
+   ASSERT_EQUAL(0x0, get_flag(&cpu, FLAG_Z), "Z");
+   ASSERT_EQUAL(ps & FLAG_I, get_ps(&cpu) & FLAG_I, "I");
+   ASSERT_EQUAL(59, cpu.cycles, "Cycles");
+
+   //A jammed CPU stays put until it is reset.
+   ASSERT_EQUAL(1, exec(&cpu, ram, 10), "Still stopped");
+   ASSERT_EQUAL(0x0216, cpu.pc, "PC after stop");
+
+   free_ram(ram);
+}
+
+//ADC and SBC as the NMOS 6502 decimal mode description gives them, one
+//branch per adjustment. Returns A and sets *ps to N, V, Z and C.
+static byte ref_add(byte a, byte b, byte c, bool d, bool sub, byte* ps) {
+   int bin = sub ? a - b - (1 - c) : a + b + c;
+   int res = bin;
+   bool carry = sub ? bin >= 0 : bin > 0xFF;
+   bool n = (bin & 0x80) != 0;
+   bool v = sub ? ((a ^ b) & (a ^ bin) & 0x80) != 0 : (~(a ^ b) & (a ^ bin) & 0x80) != 0;
+
+   if (d && sub) {
+      int lo = (a & 0x0F) - (b & 0x0F) + c - 1;
+      if (lo < 0) {
+         lo = ((lo - 0x06) & 0x0F) - 0x10;
+      }
+      res = (a & 0xF0) - (b & 0xF0) + lo;
+      if (res < 0) {
+         res -= 0x60;
+      }
+   }
+   else if (d) {
+      int lo = (a & 0x0F) + (b & 0x0F) + c;
+      if (lo >= 0x0A) {
+         lo = ((lo + 0x06) & 0x0F) + 0x10;
+      }
+      int hi = (int8_t)(a & 0xF0) + (int8_t)(b & 0xF0) + lo;
+      v = hi < -128 || hi > 127;
+      res = (a & 0xF0) + (b & 0xF0) + lo;
+      n = (res & 0x80) != 0;
+      if (res >= 0xA0) {
+         res += 0x60;
+      }
+      carry = res >= 0x100;
+   }
+
+   *ps = (byte)((n ? FLAG_N : 0) | (v ? FLAG_V : 0) | (0 == (bin & 0xFF) ? FLAG_Z : 0) | (carry ? FLAG_C : 0));
+   return (byte)res;
+}
+
+static void test_adc_sbc_exhaustive(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   reset_cpu(&cpu, 0x0200);
+
+   uint32_t mismatches = 0;
+   for (uint32_t k = 0; k < 4 * 2 * 256 * 256; k++) {
+      byte b = (byte)k;
+      byte a = (byte)(k >> 8);
+      byte c = (k >> 16) & 1;
+      bool d = (k >> 17) & 1;
+      bool sub = (k >> 18) & 1;
+
+      ram->data[0x0200] = sub ? SBC_IM : ADC_IM;
+      ram->data[0x0201] = b;
+      cpu.pc = 0x0200;
+      cpu.a = a;
+      set_ps(&cpu, (byte)((d ? FLAG_D : 0) | c));
+      exec(&cpu, ram, 1);
+
+      byte ps;
+      byte res = ref_add(a, b, c, d, sub, &ps);
+      mismatches += res != cpu.a || ps != (get_ps(&cpu) & (FLAG_N | FLAG_V | FLAG_Z | FLAG_C));
+   }
+
+   ASSERT_EQUAL(0, mismatches, "Mismatches");
+
+   free_ram(ram);
+}
+
+static void test_decode_cache_smc(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   init_decode_cache(ram);
+   reset_cpu(&cpu, 0x0200);
+
+   ram->data[0x0200] = LDA_IM;
+   ram->data[0x0201] = 0x11;
+   ram->data[0x0202] = LDX_IM;
+   ram->data[0x0203] = 0x77;
+   ram->data[0x0204] = STX_ABS;
+   ram->data[0x0205] = 0x01;
+   ram->data[0x0206] = 0x02;
+   exec(&cpu, ram, 3);
+
+   ASSERT_EQUAL(0x11, cpu.a, "A");
+   ASSERT_EQUAL(0x77, ram->data[0x0201], "Patched operand");
+
+   cpu.pc = 0x0200;
+   exec(&cpu, ram, 1);
+
+   ASSERT_EQUAL(0x77, cpu.a, "A");
+   ASSERT_EQUAL(0x0202, cpu.pc, "PC");
+   ASSERT_EQUAL(10, cpu.cycles, "Cycles");
+
+   free_ram(ram);
+}
+
+static void test_decode_cache_stack_write(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   init_decode_cache(ram);
+   reset_cpu(&cpu, 0x01FA);
+
+   ram->data[0x01FA] = LDA_IM;
+   ram->data[0x01FB] = 0x11;
+   exec(&cpu, ram, 1);
+   ASSERT_EQUAL(0x11, cpu.a, "A");
+
+   ram->data[0x0300] = LDA_IM;
+   ram->data[0x0301] = 0x22;
+   ram->data[0x0302] = PHA;
+   cpu.pc = 0x0300;
+   set_sp(&cpu, 0x01FC);
+   exec(&cpu, ram, 2);
+
+   cpu.pc = 0x01FA;
+   cpu.a = 0x0;
+   exec(&cpu, ram, 1);
+   ASSERT_EQUAL(0x22, cpu.a, "A");
+
+   free_ram(ram);
+}
+
+static void test_decode_cache_flush(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   init_decode_cache(ram);
+   reset_cpu(&cpu, 0xFFFC);
+
+   ram->data[0xFFFC] = LDA_IM;
+   ram->data[0xFFFD] = 0x42;
+   exec(&cpu, ram, 1);
+   ASSERT_EQUAL(0x42, cpu.a, "A");
+
+   ram->data[0xFFFC] = LDX_IM;
+   flush_decode_cache(ram);
+   cpu.pc = 0xFFFC;
+   exec(&cpu, ram, 1);
+
+   ASSERT_EQUAL(0x42, cpu.x, "X");
+   ASSERT_EQUAL(0xFFFE, cpu.pc, "PC");
+   ASSERT_EQUAL(4, cpu.cycles, "Cycles");
+
+   free_ram(ram);
+}
+
+//A copy loop, a delay loop and immediate and absolute stores, all fused
+//with a decode cache. The last run stores over its own INX with a DEX.
+static void load_fusion_program(struct RAM* ram) {
+   static const byte program[] = {
+      LDX_IM, 0x00,
+      LDA_ABSX, 0x00, 0x30,
+      STA_ABSX, 0x00, 0x31,
+      INX,
+      CPX_IM, 0x04,
+      BNE, 0xF5,
+      LDX_IM, 0x03,
+      DEX,
+      BNE, 0xFD,
+      LDA_IM, 0x42,
+      STA_ABS, 0x00, 0x32,
+      LDA_ABS, 0x00, 0x32,
+      STA_ABS, 0x01, 0x32,
+      LDA_ABSX, 0x00, 0x30,
+      STA_ABSX, 0x23, 0x02,
+      INX,
+      JAM
+   };
+
+   memcpy(&ram->data[0x0200], program, sizeof(program));
+   ram->data[0x3000] = DEX;
+   ram->data[0x3001] = 0x11;
+   ram->data[0x3002] = 0x80;
+   ram->data[0x3003] = 0x00;
+}
+
+static void test_fused_runs(void) {
+   PRINT_TEST_NAME();
+
+   //Every budget, including ones that end inside a fused run, must leave
+   //the same state as separate dispatches.
+   uint32_t mismatches = 0;
+   for (uint32_t n = 1; n <= 40; n++) {
+      for (int byCycles = 0; byCycles < 2; byCycles++) {
+         struct CPU cpu;
+         struct CPU ref;
+         struct RAM* ram = init_ram();
+         struct RAM* refRam = init_ram();
+         init_decode_cache(ram);
+         load_fusion_program(ram);
+         load_fusion_program(refRam);
+         reset_cpu(&cpu, 0x0200);
+         reset_cpu(&ref, 0x0200);
+
+         if (byCycles) {
+            mismatches += exec_cycles(&cpu, ram, 4 * n) != exec_cycles(&ref, refRam, 4 * n);
+         }
+         else {
+            mismatches += exec(&cpu, ram, n) != exec(&ref, refRam, n);
+         }
+         mismatches += ref.a != cpu.a || ref.x != cpu.x || ref.y != cpu.y || get_ps(&ref) != get_ps(&cpu);
+         mismatches += ref.pc != cpu.pc || ref.cycles != cpu.cycles;
+         mismatches += 0 != memcmp(refRam->data, ram->data, MEM_MAX);
+
+         free_ram(ram);
+         free_ram(refRam);
+      }
+   }
+   ASSERT_EQUAL(0, mismatches, "Mismatches");
+
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   init_decode_cache(ram);
+   load_fusion_program(ram);
+   reset_cpu(&cpu, 0x0200);
+   exec(&cpu, ram, 100);
+   ASSERT_EQUAL(DEX, ram->data[0x0223], "Patched opcode");
+   ASSERT_EQUAL(0xFF, cpu.x, "X after patched run");
+
+   //The profiler counts the runs the cached loop fuses.
+   reset_cpu(&cpu, 0x0200);
+   load_fusion_program(ram);
+   init_profiler(ram);
+   exec(&cpu, ram, 100);
+   ASSERT_EQUAL(5, ram->profile->fused[FUSE_LDA_ABSX_STA_ABSX_INX], "Copy runs");
+   ASSERT_EQUAL(3, ram->profile->fused[FUSE_DEX_BNE], "Delay runs");
+   ASSERT_EQUAL(1, ram->profile->fused[FUSE_LDA_IM_STA_ABS], "Immediate stores");
+   ASSERT_EQUAL(15, profile_fused_saving(ram->profile), "Saved dispatches");
+
+   free_ram(ram);
+}
+
+static void load_jit_program(struct RAM* ram) {
+   static const byte program[] = {
+      LDX_IM, 0x05,
+      LDY_IM, 0xF0,
+      LDA_ABSX, 0xFE, 0x30,
+      STA_ZPX, 0x10,
+      LDA_ABSY, 0x20, 0x30,
+      EOR_ZP, 0x15,
+      PHP,
+      BIT_ZP, 0x15,
+      PLP,
+      ORA_IM, 0x81,
+      AND_ABS, 0x00, 0x31,
+      PHA,
+      TAY,
+      STY_ZP, 0x20,
+      TSX,
+      PLA,
+      STA_ZP, 0x40,
+      TXA,
+      STA_ABSY, 0x00, 0x32,
+      LDY_ZPX, 0x1B,
+      STX_ZPY, 0x30,
+      TXS,
+      LDA_INDY, 0x50,
+      LDA_ZP, 0x10,
+      JAM
+   };
+
+   memcpy(&ram->data[0x0200], program, sizeof(program));
+   ram->data[0x0015] = 0x0F;
+   ram->data[0x0050] = 0x00;
+   ram->data[0x0051] = 0x31;
+   ram->data[0x3100] = 0xF7;
+   ram->data[0x3103] = 0x5A;
+   ram->data[0x3110] = 0x3C;
+   ram->data[0x01FF] = 0xEE;   //Above the byte PHA pushes, so PLA must not read it.
+}
+
+static void test_jit_matches_interp(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct CPU jitCpu;
+   struct RAM* ram = init_ram();
+   struct RAM* jitRam = init_ram();
+   if (0 != init_jit(jitRam)) {
+      printf_s("JIT not available, skipped\n");
+      free_ram(ram);
+      free_ram(jitRam);
+      return;
+   }
+   reset_cpu(&cpu, 0x0200);
+   reset_cpu(&jitCpu, 0x0200);
+   load_jit_program(ram);
+   load_jit_program(jitRam);
+
+   //Long enough for the block to get hot, then a budget that ends mid-block.
+   //SP starts over too, so PLA always has $EE above the byte it pulls.
+   for (int i = 0; i < 40; i++) {
+      cpu.pc = 0x0200;
+      jitCpu.pc = 0x0200;
+      set_sp(&cpu, 0x1FF);
+      set_sp(&jitCpu, 0x1FF);
+      exec(&cpu, ram, 24);
+      exec(&jitCpu, jitRam, 24);
+   }
+   cpu.pc = 0x0200;
+   jitCpu.pc = 0x0200;
+   exec(&cpu, ram, 7);
+   exec(&jitCpu, jitRam, 7);
+
+   ASSERT_EQUAL(cpu.a, jitCpu.a, "A");
+   ASSERT_EQUAL(cpu.x, jitCpu.x, "X");
+   ASSERT_EQUAL(cpu.y, jitCpu.y, "Y");
+   ASSERT_EQUAL(get_sp(&cpu), get_sp(&jitCpu), "SP");
+   ASSERT_EQUAL(get_ps(&cpu), get_ps(&jitCpu), "PS");
+   ASSERT_EQUAL(cpu.pc, jitCpu.pc, "PC");
+   ASSERT_EQUAL(cpu.cycles, jitCpu.cycles, "Cycles");
+   ASSERT_EQUAL(0, memcmp(&ram->data[0x0100], &jitRam->data[0x0100], PAGE_SIZE), "Stack page");
+   ASSERT_EQUAL(ram->data[0x0040], jitRam->data[0x0040], "Pulled A");
+   ASSERT_EQUAL(0, memcmp(ram->data, jitRam->data, MEM_MAX), "Memory");
+
+   free_ram(ram);
+   free_ram(jitRam);
+}
+
+//A block that runs up to $FFFF ends there, and the CPU wraps to $0000.
+static void test_jit_top_of_memory(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   if (0 != init_jit(ram)) {
+      printf_s("JIT not available, skipped\n");
+      free_ram(ram);
+      return;
+   }
+   memset(&ram->data[0xFFF0], NOP, 16);
+   reset_cpu(&cpu, 0xFFF0);
+
+   for (int i = 0; i < 40; i++) {
+      cpu.pc = 0xFFF0;
+      exec(&cpu, ram, 16);
+   }
+
+   ASSERT_EQUAL(0x0000, cpu.pc, "PC");
+   ASSERT_EQUAL(40 * 16 * 2, cpu.cycles, "Cycles");
+
+   free_ram(ram);
+}
+
+static void test_jit_smc(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   if (0 != init_jit(ram)) {
+      printf_s("JIT not available, skipped\n");
+      free_ram(ram);
+      return;
+   }
+   reset_cpu(&cpu, 0x0200);
+
+   //Patches the operand of the LDX that follows in the same block.
+   ram->data[0x0200] = LDA_ABS;
+   ram->data[0x0201] = 0x00;
+   ram->data[0x0202] = 0x03;
+   ram->data[0x0203] = STA_ABS;
+   ram->data[0x0204] = 0x07;
+   ram->data[0x0205] = 0x02;
+   ram->data[0x0206] = LDX_IM;
+   ram->data[0x0207] = 0x00;
+
+   uint32_t mismatches = 0;
+   for (uint32_t i = 0; i < 40; i++) {
+      ram->data[0x0300] = (byte)(i + 1);
+      cpu.pc = 0x0200;
+      exec(&cpu, ram, 3);
+      mismatches += (i + 1 != cpu.x);
+   }
+
+   ASSERT_EQUAL(0, mismatches, "Stale operands");
+   ASSERT_EQUAL(40, cpu.x, "X");
+   ASSERT_EQUAL(0x0208, cpu.pc, "PC");
+   ASSERT_EQUAL(400, cpu.cycles, "Cycles");
+
+   free_ram(ram);
+}
+
+static void test_run_jobs(void) {
+   PRINT_TEST_NAME();
+   struct RAM* ram = init_ram();
+   load_jit_program(ram);
+   byte* image = malloc(MEM_MAX);
+   byte* badImage = malloc(MEM_MAX);
+   memcpy(image, ram->data, MEM_MAX);
+   memcpy(badImage, ram->data, MEM_MAX);
+   badImage[0x0207] = JAM;
+
+   //More jobs than workers, with different budgets, start points and images.
+   //The last one jams on the instruction that reaches its cycle budget.
+   struct Job jobs[38];
+   struct JobResult results[38];
+   for (uint32_t k = 0; k < 37; k++) {
+      jobs[k].image = (0 == k % 5) ? badImage : image;
+      jobs[k].imageSize = MEM_MAX;
+      jobs[k].origin = 0;
+      reset_cpu(&jobs[k].state, (0 == k % 3) ? 0x0209 : 0x0200);
+      jobs[k].state.a = (byte)k;
+      jobs[k].insBudget = 1 + k % 23;
+      jobs[k].cycleBudget = (0 == k % 4) ? 10 + k : 0;
+   }
+   jobs[37] = jobs[0];
+   reset_cpu(&jobs[37].state, 0x0207);
+   jobs[37].cycleBudget = 1;
+
+   struct Runner* runner = init_runner(4);
+   int res = run_jobs(runner, jobs, results, 38);
+
+   uint32_t mismatches = 0;
+   uint32_t stops = 0;
+   for (uint32_t k = 0; k < 38; k++) {
+      struct CPU ref = jobs[k].state;
+      memcpy(ram->data, jobs[k].image, MEM_MAX);
+      if (0 != jobs[k].cycleBudget) {
+         exec_cycles(&ref, ram, jobs[k].cycleBudget);
+      }
+      else {
+         exec(&ref, ram, jobs[k].insBudget);
+      }
+      RunStop stop = (STOP_NONE != ref.stop) ? RUN_STOPPED : RUN_BUDGET;
+      stops += RUN_STOPPED == stop;
+      mismatches += stop != results[k].stop || results[k].worker >= 4;
+      mismatches += ref.a != results[k].cpu.a || ref.x != results[k].cpu.x || ref.y != results[k].cpu.y;
+      mismatches += ref.pc != results[k].cpu.pc || ref.cycles != results[k].cpu.cycles;
+      mismatches += get_ps(&ref) != get_ps(&results[k].cpu) || get_sp(&ref) != get_sp(&results[k].cpu);
+   }
+
+   free_runner(runner);
+   free(image);
+   free(badImage);
+   free_ram(ram);
+
+   ASSERT_EQUAL(0, res, "run_jobs result");
+   ASSERT_EQUAL(true, stops > 0, "Some jobs stop early");
+   ASSERT_EQUAL(RUN_STOPPED, results[37].stop, "Stop on the last cycle");
+   ASSERT_EQUAL(0, mismatches, "Mismatches");
+}
+
+struct TestDevice {
+   word lastAddr;
+   byte lastVal;
+   uint32_t reads;
+};
+
+static byte test_device_read(void* ctx, word addr) {
+   struct TestDevice* dev = ctx;
+   dev->reads++;
+   return (byte)(addr & 0xFF) | 0x80;
+}
+
+static void test_device_write(void* ctx, word addr, byte val) {
+   struct TestDevice* dev = ctx;
+   dev->lastAddr = addr;
+   dev->lastVal = val;
+}
+
+static void test_memory_map(void) {
+   PRINT_TEST_NAME();
+   static const byte rom[PAGE_SIZE] = { LDY_IM, 0x77, RTS, 0x00, 0x00, 0x5A };
+   static const byte prog[] = {
+      JSR, 0x00, 0xF0,        //Runs from ROM
+      LDA_ABS, 0x05, 0xF0,
+      STA_ABS, 0x00, 0xF0,    //Dropped
+      STA_ABS, 0x10, 0xD0,    //Device write
+      LDX_ABS, 0x01, 0xD0,    //Device read
+      LDA_ABS, 0x00, 0xF0
+   };
+   struct TestDevice dev = { 0 };
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   reset_cpu(&cpu, 0x0200);
+   memcpy(&ram->data[0x0200], prog, sizeof(prog));
+
+   ASSERT_EQUAL(true, ram->flat, "Flat before mapping");
+   ASSERT_EQUAL(1, map_ram(ram, 0x01, 0xFFFFFFFF, ram->romSink), "Page count past the end");
+   map_rom(ram, 0xF0, 1, rom);
+   map_io(ram, 0xD0, 1, &test_device_read, &test_device_write, &dev);
+   ASSERT_EQUAL(false, ram->flat, "Flat after mapping");
+
+   exec(&cpu, ram, 6);
+   ASSERT_EQUAL(0x77, cpu.y, "Y");
+   ASSERT_EQUAL(0x5A, cpu.a, "A");
+   ASSERT_EQUAL(0xD010, dev.lastAddr, "Device write address");
+   ASSERT_EQUAL(0x5A, dev.lastVal, "Device write value");
+   exec(&cpu, ram, 2);
+   ASSERT_EQUAL(0x81, cpu.x, "Device read");
+   ASSERT_EQUAL(1, dev.reads, "Device reads");
+   ASSERT_EQUAL(LDY_IM, cpu.a, "ROM unchanged");
+   ASSERT_EQUAL(0x00, ram->data[0xF000], "Backing RAM unchanged");
+
+   //Decoding code just below the device reads no bytes past it, with or
+   //without the decode cache.
+   ram->data[0xCFFD] = LDA_IM;
+   ram->data[0xCFFE] = 0x07;
+   ram->data[0xCFFF] = RTS;
+   for (int cached = 0; cached < 2; cached++) {
+      if (cached) {
+         init_decode_cache(ram);
+      }
+      cpu.pc = 0xCFFD;
+      exec(&cpu, ram, 2);
+   }
+   ASSERT_EQUAL(0x07, cpu.a, "Code below I/O");
+   ASSERT_EQUAL(1, dev.reads, "No reads past the code");
+
+   unmap_pages(ram, 0xD0, 1);
+   unmap_pages(ram, 0xF0, 1);
+   ASSERT_EQUAL(true, ram->flat, "Flat after unmapping");
+   bus_write(ram, 0xF000, 0x33);
+   ASSERT_EQUAL(0x33, bus_read(ram, 0xF000), "Bus access");
+
+   free_ram(ram);
+}
+
+static void test_snapshots(void) {
+   PRINT_TEST_NAME();
+   static const byte prog[] = {
+      LDA_IM, 0x11,
+      STA_ZP, 0x40,
+      LDA_IM, 0x22,
+      STA_ABS, 0x00, 0x30
+   };
+   struct CPU cpu;
+   struct CPU childCpu;
+   struct RAM* ram = init_ram();
+   struct RAM* child = init_ram();
+   init_decode_cache(ram);
+   reset_cpu(&cpu, 0x0200);
+   memcpy(&ram->data[0x0200], prog, sizeof(prog));
+
+   struct Snapshot* start = take_snapshot(ram, &cpu);
+   exec(&cpu, ram, 4);
+   struct Snapshot* end = take_snapshot(ram, &cpu);
+   ASSERT_EQUAL(0x11, bus_read(ram, 0x0040), "ZP after run");
+   ASSERT_EQUAL(0x22, bus_read(ram, 0x3000), "ABS after run");
+
+   //Patch decoded code, then go back to the start.
+   bus_write(ram, 0x0201, 0x99);
+   restore_snapshot(ram, &cpu, start);
+   ASSERT_EQUAL(0x0200, cpu.pc, "PC after restore");
+   ASSERT_EQUAL(0x00, bus_read(ram, 0x0040), "ZP after restore");
+   ASSERT_EQUAL(0x00, bus_read(ram, 0x3000), "ABS after restore");
+   exec(&cpu, ram, 1);
+   ASSERT_EQUAL(0x11, cpu.a, "Restored code runs");
+
+   //Fork the end state and let the copies diverge.
+   restore_snapshot(ram, &cpu, end);
+   restore_snapshot(child, &childCpu, end);
+   bus_write(child, 0x3000, 0x55);
+   ASSERT_EQUAL(0x0209, childCpu.pc, "Child PC");
+   ASSERT_EQUAL(0x55, bus_read(child, 0x3000), "Child write");
+   ASSERT_EQUAL(0x22, bus_read(ram, 0x3000), "Parent unchanged");
+   ASSERT_EQUAL(0x11, bus_read(child, 0x0040), "Child shares pages");
+
+   //Writes after a snapshot land in data and survive unmapping.
+   struct RAM* owned = init_ram();
+   bus_write(owned, 0x4000, 0x11);
+   struct Snapshot* before = take_snapshot(owned, &cpu);
+   ASSERT_EQUAL(false, owned->flat, "Not flat after snapshot");
+   bus_write(owned, 0x4000, 0x22);
+   ASSERT_EQUAL(0x22, owned->data[0x4000], "Write lands in data");
+   unmap_pages(owned, 0x40, 1);
+   ASSERT_EQUAL(0x22, bus_read(owned, 0x4000), "Write survives unmapping");
+
+   //Flat again once every captured page has been written.
+   free_snapshot(take_snapshot(owned, &cpu));
+   for (uint32_t addr = 0; addr < MEM_MAX; addr += PAGE_SIZE) {
+      bus_write(owned, (word)addr, bus_read(owned, (word)addr));
+   }
+   ASSERT_EQUAL(true, owned->flat, "Flat after writing every page");
+   restore_snapshot(owned, &cpu, before);
+   ASSERT_EQUAL(0x11, owned->data[0x4000], "Restore copies into data");
+
+   free_snapshot(before);
+   free_ram(owned);
+   free_snapshot(start);
+   free_snapshot(end);
+   free_ram(child);
+   free_ram(ram);
+}
+
+static void test_exec_cycles(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+
+   //LDA_IM takes 2 cycles, STA_ABS 4.
+   static const byte prog[] = { LDA_IM, 0x01, LDA_IM, 0x02, STA_ABS, 0x00, 0x30 };
+   memcpy(&ram->data[0x0200], prog, sizeof(prog));
+   for (word addr = 0x0207; addr < 0x0307; addr += 2) {
+      ram->data[addr] = LDA_IM;
+      ram->data[addr + 1] = 0x01;
+   }
+   ram->data[0x0307] = JAM;
+
+   reset_cpu(&cpu, 0x0200);
+   int64_t over = exec_cycles(&cpu, ram, 5);
+   ASSERT_EQUAL(3, over, "Overshoot");
+   ASSERT_EQUAL(8, cpu.cycles, "Cycles");
+   ASSERT_EQUAL(0x0207, cpu.pc, "PC");
+
+   //The total keeps counting past 32 bits.
+   cpu.cycles = 0xFFFFFFF0ull;
+   over = exec_cycles(&cpu, ram, 0x20);
+   ASSERT_EQUAL(0, over, "Overshoot past 32 bits");
+   ASSERT_EQUAL(true, 0x100000010ull == cpu.cycles, "64-bit cycles");
+
+   //Runs into the JAM at 0x0307 before the budget is used up.
+   over = exec_cycles(&cpu, ram, 1000);
+   ASSERT_EQUAL(true, over < 0, "Stopped early");
+   ASSERT_EQUAL(0x0308, cpu.pc, "PC after stop");
+
+   free_ram(ram);
+}
+
+//Base cycles and addressing mode of every opcode as ins.h lists them.
+#define CYCLE_ENTRY(name, opcode, kind, reg, src, mode, cycles) [name] = cycles,
+static const byte baseCycles[256] = { INS_LIST(CYCLE_ENTRY) };
+#undef CYCLE_ENTRY
+#define MODE_ENTRY(name, opcode, kind, reg, src, mode, cycles) [name] = mode,
+static const byte baseModes[256] = { INS_LIST(MODE_ENTRY) };
+#undef MODE_ENTRY
+#define READS_ENTRY(name, opcode, kind, reg, src, mode, cycles) \
+   [name] = OP_LD == OP_##kind || OP_AND == OP_##kind || OP_EOR == OP_##kind || OP_ORA == OP_##kind \
+      || OP_ADC == OP_##kind || OP_SBC == OP_##kind || OP_CMP == OP_##kind || OP_BIT == OP_##kind \
+      || OP_LAX == OP_##kind || OP_LAS == OP_##kind || OP_SKP == OP_##kind,
+static const bool readsOperand[256] = { INS_LIST(READS_ENTRY) };
+#undef READS_ENTRY
+
+static void test_cycle_table(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+
+   //Every opcode once with zero indexes and once with indexes of 0xFF, at
+   //an address where taken branches land in the next page. Operands point
+   //at $3010, so only the second run crosses pages, and only reads of
+   //indexed modes pay for it.
+   uint32_t mismatches = 0;
+   for (uint32_t op = 0; op < 256; op++) {
+      for (int crossing = 0; crossing < 2; crossing++) {
+         word start = crossing ? 0x02F0 : 0x0200;
+         memset(ram->data, 0, MEM_MAX);
+         ram->data[start] = (byte)op;
+         ram->data[start + 1] = 0x10;
+         ram->data[start + 2] = 0x30;
+         ram->data[0x10] = 0x10;
+         ram->data[0x11] = 0x30;
+         reset_cpu(&cpu, start);
+         cpu.x = crossing ? 0xFF : 0;
+         cpu.y = cpu.x;
+
+         exec(&cpu, ram, 1);
+         uint64_t expected = baseCycles[op];
+         byte mode = baseModes[op];
+         if (crossing && readsOperand[op] && (MODE_ABSX == mode || MODE_ABSY == mode || MODE_INDY == mode)) {
+            expected++;
+         }
+         if (MODE_REL == mode && (word)(start + 2) != cpu.pc) {
+            expected += crossing ? 2 : 1;
+         }
+         mismatches += expected != cpu.cycles;
+      }
+   }
+   ASSERT_EQUAL(0, mismatches, "Opcodes off their base cycles");
+
+   free_ram(ram);
+}
+
+//Timer device: raises IRQ source 1 every period cycles once started, and
+//lowers it on any write to its I/O page.
+struct TestTimer {
+   struct RAM* ram;
+   uint64_t period;   //0 for a one-shot.
+   uint32_t fired;
+};
+
+static void test_timer_event(void* ctx, struct RAM* ram, uint64_t cycle) {
+   struct TestTimer* timer = ctx;
+   timer->fired++;
+   set_irq(ram, 1, true);
+   if (0 != timer->period) {
+      schedule_event(ram, cycle + timer->period, &test_timer_event, timer);
+   }
+}
+
+static void test_timer_ack(void* ctx, word addr, byte val) {
+   (void)addr;
+   (void)val;
+   struct TestTimer* timer = ctx;
+   set_irq(timer->ram, 1, false);
+}
+
+static void test_nmi_event(void* ctx, struct RAM* ram, uint64_t cycle) {
+   (void)ctx;
+   (void)cycle;
+   trigger_nmi(ram);
+}
+
+static void test_interrupts(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   struct TestTimer timer = { .ram = ram, .period = 0, .fired = 0 };
+
+   //Counts X to 0x20 with I set, then idles with I clear. The IRQ handler
+   //counts in Y and acknowledges the timer, the NMI handler loads A.
+   static const byte prog[] = {
+      SEI,
+      LDX_IM, 0x00,
+      INX,
+      CPX_IM, 0x20,
+      BNE, 0xFB,
+      CLI,
+      JMP_ABS, 0x09, 0x02
+   };
+   static const byte irq[] = { INY, STA_ABS, 0x00, 0xD0, RTI };
+   static const byte nmi[] = { LDA_IM, 0x42, RTI };
+   static const byte unmask[] = { LDA_IM, 0x00, PHA, PLP, JMP_ABS, 0x44, 0x02 };
+   memcpy(&ram->data[0x0200], prog, sizeof(prog));
+   memcpy(&ram->data[0x0240], unmask, sizeof(unmask));
+   memcpy(&ram->data[0x0300], irq, sizeof(irq));
+   memcpy(&ram->data[0x0380], nmi, sizeof(nmi));
+   ram->data[0xFFFA] = 0x80;
+   ram->data[0xFFFB] = 0x03;
+   ram->data[0xFFFE] = 0x00;
+   ram->data[0xFFFF] = 0x03;
+   map_io(ram, 0xD0, 1, NULL, &test_timer_ack, &timer);
+   ASSERT_EQUAL(0, init_scheduler(ram), "Scheduler");
+
+   //The IRQ comes up while I is set and is taken right after CLI.
+   reset_cpu(&cpu, 0x0200);
+   schedule_event(ram, 10, &test_timer_event, &timer);
+   exec_cycles(&cpu, ram, 300);
+   ASSERT_EQUAL(1, timer.fired, "One-shot fired");
+   ASSERT_EQUAL(1, cpu.y, "IRQs taken");
+   ASSERT_EQUAL(0x20, cpu.x, "Loop done before the IRQ");
+   ASSERT_EQUAL(0x0209, ram->data[0x01FD] | (ram->data[0x01FE] << 8), "Pushed PC");
+   ASSERT_EQUAL(0, ram->data[0x01FC] & (FLAG_B | FLAG_I), "Pushed B and I");
+   ASSERT_EQUAL(0, get_flag(&cpu, FLAG_I), "I after RTI");
+   ASSERT_EQUAL(0x01FF, get_sp(&cpu), "SP after RTI");
+
+   //An NMI ignores I and goes through $FFFA.
+   set_flag(&cpu, FLAG_I, 1);
+   schedule_event(ram, cpu.cycles + 20, &test_nmi_event, NULL);
+   exec_cycles(&cpu, ram, 100);
+   ASSERT_EQUAL(0x42, cpu.a, "NMI handler ran");
+   ASSERT_EQUAL(FLAG_I, ram->data[0x01FC] & (FLAG_B | FLAG_I), "Pushed B and I");
+   ASSERT_EQUAL(1, get_flag(&cpu, FLAG_I), "I after RTI");
+
+   //A periodic timer: each event is one IRQ, until it is cancelled.
+   set_flag(&cpu, FLAG_I, 0);
+   cpu.y = 0;
+   timer.fired = 0;
+   timer.period = 100;
+   schedule_event(ram, cpu.cycles + 100, &test_timer_event, &timer);
+   exec_cycles(&cpu, ram, 1050);
+   ASSERT_EQUAL(10, timer.fired, "Periodic fired");
+   ASSERT_EQUAL(10, cpu.y, "Periodic IRQs taken");
+   cancel_events(ram, &test_timer_event, &timer);
+   exec_cycles(&cpu, ram, 1000);
+   ASSERT_EQUAL(10, timer.fired, "Cancelled");
+   ASSERT_EQUAL(0x0209, cpu.pc, "Idle loop");
+
+   //PLP and RTI clearing I take a held IRQ right after them too.
+   reset_cpu(&cpu, 0x0240);
+   set_flag(&cpu, FLAG_I, 1);
+   set_irq(ram, 1, true);
+   exec_cycles(&cpu, ram, 100);
+   ASSERT_EQUAL(1, cpu.y, "IRQ after PLP");
+   ASSERT_EQUAL(0x0244, ram->data[0x01FD] | (ram->data[0x01FE] << 8), "Pushed PC after PLP");
+   reset_cpu(&cpu, 0x0209);
+   set_irq(ram, 1, true);
+   trigger_nmi(ram);
+   exec_cycles(&cpu, ram, 100);
+   ASSERT_EQUAL(0x42, cpu.a, "NMI before IRQ");
+   ASSERT_EQUAL(1, cpu.y, "IRQ after RTI");
+   ASSERT_EQUAL(0x0209, ram->data[0x01FD] | (ram->data[0x01FE] << 8), "Pushed PC after RTI");
+
+   free_ram(ram);
+}
+
+//The interrupt tests above ack through an I/O page, which keeps the JIT
+//off. Here the RAM stays flat and the IRQ handler is a JAM.
+static void test_jit_interrupts(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   if (0 != init_jit(ram)) {
+      printf_s("JIT not available, skipped\n");
+      free_ram(ram);
+      return;
+   }
+   ASSERT_EQUAL(0, init_scheduler(ram), "Scheduler");
+
+   //Each unmasks I in the middle of a compiled block.
+   static const byte cli[] = { SEI, CLI, INX, INX, INX, JMP_ABS, 0x00, 0x02 };
+   static const byte plp[] = { SEI, LDA_IM, 0x00, PHA, PLP, INX, INX, INX, JMP_ABS, 0x40, 0x02 };
+   memcpy(&ram->data[0x0200], cli, sizeof(cli));
+   memcpy(&ram->data[0x0240], plp, sizeof(plp));
+   ram->data[0x0300] = JAM;
+   ram->data[0xFFFE] = 0x00;
+   ram->data[0xFFFF] = 0x03;
+
+   static const word starts[] = { 0x0200, 0x0240 };
+   static const word unmasked[] = { 0x0202, 0x0245 };
+   for (int k = 0; k < 2; k++) {
+      //Runs the loop until its block is compiled, with no IRQ held.
+      reset_cpu(&cpu, starts[k]);
+      exec_cycles(&cpu, ram, 2000);
+      ASSERT_EQUAL(true, ram->flat, "Flat");
+
+      cpu.pc = starts[k];
+      cpu.x = 0;
+      set_flag(&cpu, FLAG_I, 1);
+      set_irq(ram, 1, true);
+      exec_cycles(&cpu, ram, 100);
+      set_irq(ram, 1, false);
+      word sp = get_sp(&cpu);
+      ASSERT_EQUAL(STOP_JAM, cpu.stop, "IRQ taken");
+      ASSERT_EQUAL(0, cpu.x, "Block left after unmasking");
+      ASSERT_EQUAL(unmasked[k], ram->data[sp + 1] | (ram->data[sp + 2] << 8), "Pushed PC");
+   }
+
+   free_ram(ram);
+}
+
+static uint32_t count_bus_mismatches(const struct RAM* ram, const byte* mem) {
+   uint32_t mismatches = 0;
+   for (uint32_t addr = 0; addr < MEM_MAX; addr++) {
+      mismatches += bus_read(ram, (word)addr) != mem[addr];
+   }
+   return mismatches;
+}
+
+static void test_rewind(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   init_decode_cache(ram);
+
+   //Increments every byte of a page, then patches itself to move on to the
+   //next page, so each keyframe has a few dirty pages.
+   static const byte prog[] = {
+      INC_ABSX, 0x00, 0x30,
+      INX,
+      BNE, 0xFA,
+      INC_ABS, 0x02, 0x02,
+      JMP_ABS, 0x00, 0x02
+   };
+   memcpy(&ram->data[0x0200], prog, sizeof(prog));
+   reset_cpu(&cpu, 0x0200);
+
+   struct Rewind* rw = init_rewind(5000, 1 << 20);
+   struct CPU refs[2];
+   byte* refMem[2] = { malloc(MEM_MAX), malloc(MEM_MAX) };
+   for (int step = 0; step < 40; step++) {
+      exec_cycles(&cpu, ram, 2500);
+      ASSERT_EQUAL(0, rewind_record(rw, ram, &cpu), "Record");
+      if (10 == step || 25 == step) {
+         int r = (10 == step) ? 0 : 1;
+         refs[r] = cpu;
+         for (uint32_t addr = 0; addr < MEM_MAX; addr++) {
+            refMem[r][addr] = bus_read(ram, (word)addr);
+         }
+      }
+   }
+   ASSERT_EQUAL(20, rw->count, "Keyframes");
+   ASSERT_EQUAL(true, rw->used < 20 * MEM_MAX / 8, "Only dirty pages per keyframe");
+
+   //Seeks replay from a keyframe to the exact instruction.
+   for (int r = 1; r >= 0; r--) {
+      ASSERT_EQUAL(0, rewind_seek(rw, ram, &cpu, refs[r].cycles), "Seek");
+      ASSERT_EQUAL(true, refs[r].cycles == cpu.cycles, "Cycles");
+      ASSERT_EQUAL(refs[r].pc, cpu.pc, "PC");
+      ASSERT_EQUAL(refs[r].x, cpu.x, "X");
+      ASSERT_EQUAL(get_ps(&refs[r]), get_ps(&cpu), "PS");
+      ASSERT_EQUAL(0, count_bus_mismatches(ram, refMem[r]), "Memory");
+   }
+   ASSERT_EQUAL(true, rw->count <= 6, "Later keyframes dropped");
+   ASSERT_EQUAL(1, rewind_seek(rw, ram, &cpu, 100), "Before the oldest keyframe");
+
+   //Running on after a seek reaches the same state as the first time.
+   exec_cycles(&cpu, ram, (int64_t)(refs[1].cycles - cpu.cycles));
+   ASSERT_EQUAL(refs[1].pc, cpu.pc, "PC replayed");
+   ASSERT_EQUAL(0, count_bus_mismatches(ram, refMem[1]), "Memory replayed");
+   free_rewind(rw);
+
+   //A tight budget keeps only the newest keyframes.
+   rw = init_rewind(5000, 4096);
+   for (int step = 0; step < 40; step++) {
+      exec_cycles(&cpu, ram, 2500);
+      rewind_record(rw, ram, &cpu);
+   }
+   ASSERT_EQUAL(true, rw->used <= 4096 || 1 == rw->count, "Within budget");
+   ASSERT_EQUAL(true, rw->count < 20, "Oldest dropped");
+   free_rewind(rw);
+
+   free(refMem[0]);
+   free(refMem[1]);
+   free_ram(ram);
+}
+
+#ifdef CPU_DIRTY_PAGES
+//Lists the dirty pages of ram into pages. Returns how many there are.
+static uint32_t list_dirty_pages(const struct RAM* ram, uint32_t* pages) {
+   uint32_t count = 0;
+   for (uint32_t p = next_dirty_page(ram, 0); p < PAGE_COUNT; p = next_dirty_page(ram, p + 1)) {
+      pages[count++] = p;
+   }
+   return count;
+}
+
+static void test_dirty_pages(void) {
+   PRINT_TEST_NAME();
+   static const byte prog[] = {
+      LDA_IM, 0x5A,
+      STA_ABS, 0x00, 0x30,
+      STA_ZP, 0x45,
+      LDX_IM, 0x10,
+      STA_ABSX, 0xF8, 0x7F,
+      PHA
+   };
+   uint32_t pages[PAGE_COUNT];
+   struct CPU cpu;
+
+   //Every engine marks the same pages: the interpreter, the decode cache
+   //and, where available, compiled stores.
+   for (int engine = 0; engine < 3; engine++) {
+      struct RAM* ram = init_ram();
+      ASSERT_EQUAL(PAGE_COUNT, next_dirty_page(ram, 0), "Clean after init");
+      memcpy(&ram->data[0x0200], prog, sizeof(prog));
+      if (1 == engine) {
+         init_decode_cache(ram);
+      }
+      else if (2 == engine && 0 != init_jit(ram)) {
+         printf_s("JIT not available, skipped\n");
+         free_ram(ram);
+         continue;
+      }
+
+      //Warm up until the block is decoded or compiled, then check the
+      //pages marked by the runs after that.
+      reset_cpu(&cpu, 0x0200);
+      for (int i = 0; i < 40; i++) {
+         cpu.pc = 0x0200;
+         exec(&cpu, ram, 6);
+      }
+      clear_dirty_pages(ram);
+      cpu.pc = 0x0200;
+      exec(&cpu, ram, 6);
+      ASSERT_EQUAL(4, list_dirty_pages(ram, pages), "Dirty count");
+      ASSERT_EQUAL(0x00, pages[0], "Zero page");
+      ASSERT_EQUAL(0x01, pages[1], "Stack page");
+      ASSERT_EQUAL(0x30, pages[2], "Absolute");
+      ASSERT_EQUAL(0x80, pages[3], "Indexed, across a page");
+      ASSERT_EQUAL(false, is_page_dirty(ram, 0x02), "Code page");
+      free_ram(ram);
+   }
+
+   struct RAM* ram = init_ram();
+   struct TestDevice dev = { 0 };
+   map_io(ram, 0xD0, 1, &test_device_read, &test_device_write, &dev);
+   bus_write(ram, 0xD000, 0x01);
+   ASSERT_EQUAL(PAGE_COUNT, next_dirty_page(ram, 0), "I/O not tracked");
+
+   static const byte block[4] = { 1, 2, 3, 4 };
+   bus_write_block(ram, 0x40FE, block, sizeof(block));
+   ASSERT_EQUAL(2, list_dirty_pages(ram, pages), "Block count");
+   ASSERT_EQUAL(0x41, pages[1], "Block end");
+   clear_dirty_pages(ram);
+   ASSERT_EQUAL(PAGE_COUNT, next_dirty_page(ram, 0), "Clean after clear");
+
+   //Writes to shared pages and restores both count.
+   reset_cpu(&cpu, 0x0200);
+   struct Snapshot* snap = take_snapshot(ram, &cpu);
+   bus_write(ram, 0x3000, 0x77);
+   ASSERT_EQUAL(0x30, next_dirty_page(ram, 0), "Copy-on-write");
+   clear_dirty_pages(ram);
+   restore_snapshot(ram, &cpu, snap);
+   ASSERT_EQUAL(1, list_dirty_pages(ram, pages), "Restore count");
+   ASSERT_EQUAL(0x30, pages[0], "Restored page");
+
+   free_snapshot(snap);
+   free_ram(ram);
+}
+#endif // CPU_DIRTY_PAGES
+
+static void write_test_file(const char* path, const void* bytes, size_t len) {
+   FILE* file = fopen(path, "wb");
+   if (NULL != file) {
+      fwrite(bytes, 1, len, file);
+      fclose(file);
+   }
+}
+
+static void test_loader(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct Image img;
+   struct RAM* ram = init_ram();
+   int res;
+
+   //4 KiB ROM at $F000 whose reset vector points at an STA into itself.
+   byte* rom = calloc(0x1000, 1);
+   rom[0x0000] = STA_ABS;
+   rom[0x0001] = 0x00;
+   rom[0x0002] = 0xF0;
+   rom[0x0FFC] = 0x00;
+   rom[0x0FFD] = 0xF0;
+   write_test_file("test_image.bin", rom, 0x1000);
+   res = open_image(&img, "test_image.bin", IMAGE_AUTO, 0xF000);
+   ASSERT_EQUAL(0, res, "Open raw");
+   res = load_and_reset(&cpu, ram, &img, true);
+   ASSERT_EQUAL(0, res, "Load and reset");
+   ASSERT_EQUAL(0xF000, cpu.pc, "PC from reset vector");
+   cpu.a = 0x42;
+   exec(&cpu, ram, 1);
+   ASSERT_EQUAL(STA_ABS, bus_read(ram, 0xF000), "ROM write-protected");
+   unmap_pages(ram, 0xF0, 16);
+   close_image(&img);
+
+   //.prg with a partial last page.
+   byte prg[2 + 300] = { 0x00, 0x10 };
+   prg[2 + 299] = 0x99;
+   write_test_file("test_image.prg", prg, sizeof(prg));
+   res = open_image(&img, "test_image.prg", IMAGE_AUTO, 0);
+   ASSERT_EQUAL(0, res, "Open prg");
+   ASSERT_EQUAL(0x1000, img.origin, "PRG origin");
+   ASSERT_EQUAL(300, img.size, "PRG size");
+   res = map_image(ram, &img);
+   ASSERT_EQUAL(0, res, "Map prg");
+   ASSERT_EQUAL(0x99, bus_read(ram, 0x112B), "PRG tail byte");
+   unmap_pages(ram, 0x10, 2);
+   close_image(&img);
+
+   //The same three bytes as Intel HEX and S-record.
+   static const char ihex[] = ":0302000011223395\n:00000001FF\n";
+   static const char srec[] = "S0030000FC\nS106020011223391\nS9030000FC\n";
+   write_test_file("test_image.hex", ihex, sizeof(ihex) - 1);
+   write_test_file("test_image.s19", srec, sizeof(srec) - 1);
+   const char* texts[] = { "test_image.hex", "test_image.s19" };
+   for (int k = 0; k < 2; k++) {
+      res = open_image(&img, texts[k], IMAGE_AUTO, 0);
+      ASSERT_EQUAL(0, res, "Open text image");
+      ASSERT_EQUAL(0x0200, img.origin, "Text origin");
+      ASSERT_EQUAL(3, img.size, "Text size");
+      res = load_image(ram, &img);
+      ASSERT_EQUAL(0, res, "Load text image");
+      ASSERT_EQUAL(0x33, bus_read(ram, 0x0202), "Text data");
+      close_image(&img);
+      bus_write(ram, 0x0202, 0x00);
+   }
+
+   remove("test_image.bin");
+   remove("test_image.prg");
+   remove("test_image.hex");
+   remove("test_image.s19");
+   free(rom);
+   free_ram(ram);
+}
+
+#ifdef CPU_TRACE
+static void test_trace(void) {
+   PRINT_TEST_NAME();
+   static const byte prog[] = {
+      LDA_IM, 0x42,
+      STA_ZP, 0x40,
+      JSR, 0x00, 0x03
+   };
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+   reset_cpu(&cpu, 0x0200);
+   memcpy(&ram->data[0x0200], prog, sizeof(prog));
+
+   int res = start_trace(ram, "test_trace.bin");
+   ASSERT_EQUAL(0, res, "Start trace");
+   exec(&cpu, ram, 3);
+   stop_trace(ram);
+
+   //LDA, STA + write, JSR + two pushes.
+   struct TraceRecord recs[8];
+   char magic[8];
+   size_t count = 0;
+   FILE* file = fopen("test_trace.bin", "rb");
+   if (NULL != file) {
+      if (sizeof(magic) == fread(magic, 1, sizeof(magic), file)) {
+         count = fread(recs, sizeof(struct TraceRecord), 8, file);
+      }
+      fclose(file);
+   }
+   remove("test_trace.bin");
+
+   ASSERT_EQUAL(6, count, "Records");
+   ASSERT_EQUAL(0, memcmp(magic, TRACE_MAGIC, sizeof(magic)), "Magic");
+   ASSERT_EQUAL(TRACE_INS, recs[0].kind, "LDA kind");
+   ASSERT_EQUAL(0x0200, recs[0].addr, "LDA PC");
+   ASSERT_EQUAL(LDA_IM, recs[0].val, "LDA opcode");
+   ASSERT_EQUAL(0x42, recs[1].a, "A before STA");
+   ASSERT_EQUAL(2, recs[1].cycles, "Cycles before STA");
+   ASSERT_EQUAL(TRACE_WRITE, recs[2].kind, "STA write kind");
+   ASSERT_EQUAL(0x0040, recs[2].addr, "STA write address");
+   ASSERT_EQUAL(0x42, recs[2].val, "STA write value");
+   ASSERT_EQUAL(JSR, recs[3].val, "JSR opcode");
+   ASSERT_EQUAL(0x01FE, recs[4].addr, "Push address");
+   ASSERT_EQUAL(0x02, recs[4].val, "Push value");
+
+   free_ram(ram);
+}
+#endif // CPU_TRACE
+
+static void test_profiler(void) {
+   PRINT_TEST_NAME();
+   struct CPU cpu;
+   struct RAM* ram = init_ram();
+
+   //Two calls to $0210, which calls $0220.
+   static const byte prog[] = { JSR, 0x10, 0x02, JSR, 0x10, 0x02, LDA_IM, 0x01 };
+   static const byte sub1[] = { JSR, 0x20, 0x02, RTS };
+   static const byte sub2[] = { LDA_IM, 0x02, RTS };
+   memcpy(&ram->data[0x0200], prog, sizeof(prog));
+   memcpy(&ram->data[0x0210], sub1, sizeof(sub1));
+   memcpy(&ram->data[0x0220], sub2, sizeof(sub2));
+
+   int res = init_profiler(ram);
+   ASSERT_EQUAL(0, res, "Init profiler");
+   reset_cpu(&cpu, 0x0200);
+   res = exec(&cpu, ram, 11);
+   ASSERT_EQUAL(0, res, "Exec");
+   ASSERT_EQUAL(0x0208, cpu.pc, "PC");
+
+   const struct Profile* prof = ram->profile;
+   ASSERT_EQUAL(4, prof->opCount[JSR], "JSR count");
+   ASSERT_EQUAL(4, prof->opCount[RTS], "RTS count");
+   ASSERT_EQUAL(3, prof->opCount[LDA_IM], "LDA count");
+   ASSERT_EQUAL(2 * prof->opCycles[LDA_IM] / 3, prof->pcCycles[0x0220], "PC cycles");
+   ASSERT_EQUAL(3, prof->frameCount, "Frames");
+   ASSERT_EQUAL(0, prof->frame, "Back at the root");
+   ASSERT_EQUAL(0x0210, prof->frames[1].entry, "Outer entry");
+   ASSERT_EQUAL(2, prof->frames[1].calls, "Outer calls");
+   ASSERT_EQUAL(0x0220, prof->frames[2].entry, "Inner entry");
+   ASSERT_EQUAL(1, prof->frames[2].parent, "Inner parent");
+
+   uint64_t total = 0;
+   for (uint32_t k = 0; k < prof->frameCount; k++) {
+      total += prof->frames[k].cycles;
+   }
+   ASSERT_EQUAL(true, total == cpu.cycles, "Frame cycles add up");
+
+   char text[256] = { 0 };
+   FILE* file = tmpfile();
+   write_profile_collapsed(prof, file);
+   rewind(file);
+   size_t len = fread(text, 1, sizeof(text) - 1, file);
+   fclose(file);
+   ASSERT_EQUAL(true, 0 != len && NULL != strstr(text, "root;sub_0210;sub_0220 "), "Collapsed stack");
+
+   memset(text, 0, sizeof(text));
+   file = tmpfile();
+   write_profile_json(prof, file);
+   rewind(file);
+   len = fread(text, 1, sizeof(text) - 1, file);
+   fclose(file);
+   ASSERT_EQUAL(true, 0 != len && 0 == strncmp(text, "{\"instructions\":11,", 19), "JSON");
+
+   free_ram(ram);
+}
+
+static void test_exec_fast(void) {
+   PRINT_TEST_NAME();
+   struct CPU accurate;
+   struct CPU fast;
+   struct RAM* ramA = init_ram();
+   struct RAM* ramF = init_ram();
+
+   //Page-crossing index, stack traffic and a subroutine call.
+   static const byte prog[] = {
+      LDX_IM, 0xFF, LDA_ABSX, 0x01, 0x30, PHA, JSR, 0x20, 0x02,
+      PLA, STA_INDY, 0x10, TSX, ORA_IM, 0x0C
+   };
+   static const byte sub[] = { TAY, ADC_IM, 0x7F, STA_ZPX, 0x40, RTS };
+   struct RAM* rams[] = { ramA, ramF };
+   for (int k = 0; k < 2; k++) {
+      memcpy(&rams[k]->data[0x0200], prog, sizeof(prog));
+      memcpy(&rams[k]->data[0x0220], sub, sizeof(sub));
+      rams[k]->data[0x3100] = 0x81;
+      rams[k]->data[0x10] = 0xF0;
+      rams[k]->data[0x11] = 0x30;
+   }
+
+   reset_cpu(&accurate, 0x0200);
+   reset_cpu(&fast, 0x0200);
+   int res = exec(&accurate, ramA, 12);
+   ASSERT_EQUAL(0, res, "Accurate run");
+   res = exec_fast(&fast, ramF, 12);
+   ASSERT_EQUAL(0, res, "Fast run");
+
+   ASSERT_EQUAL(accurate.pc, fast.pc, "PC");
+   ASSERT_EQUAL(accurate.a, fast.a, "A");
+   ASSERT_EQUAL(accurate.x, fast.x, "X");
+   ASSERT_EQUAL(accurate.y, fast.y, "Y");
+   ASSERT_EQUAL(get_sp(&accurate), get_sp(&fast), "SP");
+   ASSERT_EQUAL(get_ps(&accurate), get_ps(&fast), "PS");
+   ASSERT_EQUAL(0, memcmp(ramA->data, ramF->data, MEM_MAX), "Memory");
+   ASSERT_EQUAL(true, 0 != accurate.cycles, "Accurate cycles");
+   ASSERT_EQUAL(true, 0 == fast.cycles, "No fast cycles");
+
+   free_ram(ramA);
+   free_ram(ramF);
+}
+
 void(*tests[])(void) = {
    &test_reset_cpu,
+   &test_flag_accessors,
    &test_jsr,
    &test_rts,
    &test_lda_imm,
@@ -1692,6 +3080,8 @@ void(*tests[])(void) = {
    &test_php,
    &test_pla,
    &test_plp,
+   &test_php_lazy_flags,
+   &test_plp_php_roundtrip,
    &test_and_imm,
    &test_and_zp,
    &test_and_zp_x,
@@ -1717,11 +3107,43 @@ void(*tests[])(void) = {
    &test_ora_ind_x,
    &test_ora_ind_y,
    &test_bit_zp,
-   &test_bit_abs
+   &test_bit_abs,
+   &test_bit_flags_from_operand,
+   &test_adc_abs_x,
+   &test_full_opcode_set,
+   &test_adc_sbc_exhaustive,
+   &test_decode_cache_smc,
+   &test_decode_cache_stack_write,
+   &test_decode_cache_flush,
+   &test_fused_runs,
+   &test_jit_matches_interp,
+   &test_jit_top_of_memory,
+   &test_jit_smc,
+   &test_run_jobs,
+   &test_memory_map,
+   &test_snapshots,
+   &test_exec_cycles,
+   &test_cycle_table,
+   &test_interrupts,
+   &test_jit_interrupts,
+   &test_rewind,
+#ifdef CPU_DIRTY_PAGES
+   &test_dirty_pages,
+#else
+   NULL,
+#endif // CPU_DIRTY_PAGES
+   &test_loader,
+#ifdef CPU_TRACE
+   &test_trace,
+#else
+   NULL,
+#endif // CPU_TRACE
+   &test_profiler,
+   &test_exec_fast
 };
 
 void run_tests() {
-   for (uint32_t i = 0; i <= TEST_COUNT; i++) {
+   for (uint32_t i = 0; i < TEST_COUNT; i++) {
       if (NULL != tests[i]) {
          tests[i]();
       }
@@ -0,0 +1,159 @@
+#include "../include/trace.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+#define TRACE_FILE_BUFFER (1 << 20)
+#define TRACE_IDLE_NS 1000000   //Longest the writer sleeps with records pending.
+
+struct Trace {
+   struct TraceRing ring;   //First, so ram->trace converts back.
+   atomic_bool stop;
+   FILE* file;
+   char* buffer;
+   thrd_t writer;
+   mtx_t lock;
+   cnd_t wake;
+};
+
+void trace_kick(struct TraceRing* ring) {
+   struct Trace* t = (struct Trace*)ring;
+   mtx_lock(&t->lock);
+   cnd_signal(&t->wake);
+   mtx_unlock(&t->lock);
+}
+
+void trace_wait(struct TraceRing* ring) {
+   unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+   trace_kick(ring);
+   for (;;) {
+      ring->cachedTail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+      if (TRACE_RING_SIZE != head - ring->cachedTail) {
+         return;
+      }
+      thrd_yield();
+   }
+}
+
+#ifdef CPU_TRACE
+//Drains the ring in contiguous runs. Sleeps while it is empty until kicked
+//or for TRACE_IDLE_NS; stop is read before head so the records pushed
+//before stop_trace() are all written.
+static int trace_writer(void* arg) {
+   struct Trace* t = arg;
+   struct TraceRing* ring = &t->ring;
+   unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+   for (;;) {
+      bool stopping = atomic_load_explicit(&t->stop, memory_order_acquire);
+      unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+      if (head == tail) {
+         if (stopping) {
+            return 0;
+         }
+         struct timespec until;
+         timespec_get(&until, TIME_UTC);
+         until.tv_nsec += TRACE_IDLE_NS;
+         if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+         }
+         mtx_lock(&t->lock);
+         if (head == atomic_load_explicit(&ring->head, memory_order_acquire) && !atomic_load_explicit(&t->stop, memory_order_acquire)) {
+            cnd_timedwait(&t->wake, &t->lock, &until);
+         }
+         mtx_unlock(&t->lock);
+         continue;
+      }
+
+      unsigned start = tail & (TRACE_RING_SIZE - 1);
+      unsigned count = head - tail;
+      if (count > TRACE_RING_SIZE - start) {
+         count = TRACE_RING_SIZE - start;
+      }
+      fwrite(&ring->records[start], sizeof(struct TraceRecord), count, t->file);
+      tail += count;
+      atomic_store_explicit(&ring->tail, tail, memory_order_release);
+   }
+}
+#endif // CPU_TRACE
+
+int start_trace(struct RAM* ram, const char* path) {
+#ifndef CPU_TRACE
+   (void)ram;
+   (void)path;
+   return 1;
+#else
+   if (NULL != ram->trace) {
+      return 1;
+   }
+
+   struct Trace* t = calloc(1, sizeof(struct Trace));
+   if (NULL == t) {
+      printf_s("Allocation error");
+      return 1;
+   }
+
+   t->file = fopen(path, "wb");
+   t->buffer = malloc(TRACE_FILE_BUFFER);
+   if (NULL == t->file || NULL == t->buffer) {
+      printf_s("Cannot open trace file %s\n", path);
+      if (NULL != t->file) {
+         fclose(t->file);
+      }
+      free(t->buffer);
+      free(t);
+      return 1;
+   }
+   setvbuf(t->file, t->buffer, _IOFBF, TRACE_FILE_BUFFER);
+   fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), t->file);
+
+   atomic_init(&t->ring.head, 0);
+   atomic_init(&t->ring.tail, 0);
+   atomic_init(&t->stop, false);
+   mtx_init(&t->lock, mtx_plain);
+   cnd_init(&t->wake);
+   if (thrd_success != thrd_create(&t->writer, trace_writer, t)) {
+      printf_s("Thread creation error");
+      cnd_destroy(&t->wake);
+      mtx_destroy(&t->lock);
+      fclose(t->file);
+      free(t->buffer);
+      free(t);
+      return 1;
+   }
+
+   ram->trace = &t->ring;
+   flush_decode_cache(ram);   //Drops fused runs, which would skip fetch records.
+
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Started trace to %s\n", path);
+#endif // _DEBUG
+
+   return 0;
+#endif // !CPU_TRACE
+}
+
+void stop_trace(struct RAM* ram) {
+   if (NULL == ram->trace) {
+      return;
+   }
+
+   struct Trace* t = (struct Trace*)ram->trace;
+   ram->trace = NULL;
+   flush_decode_cache(ram);
+   atomic_store_explicit(&t->stop, true, memory_order_release);
+   trace_kick(&t->ring);
+   thrd_join(t->writer, NULL);
+
+   cnd_destroy(&t->wake);
+   mtx_destroy(&t->lock);
+   fclose(t->file);
+   free(t->buffer);
+   free(t);
+
+#ifdef _DEBUG
+   printf_s("DEBUG\t| Stopped trace\n");
+#endif // _DEBUG
+}
@@ -0,0 +1,59 @@
+#include "../include/trace.h"
+#include <stdio.h>
+#include <string.h>
+
+//Prints a binary trace written by start_trace() as text, one instruction
+//per line followed by its memory accesses.
+int main(int argc, char** argv) {
+   if (argc < 2) {
+      printf_s("Usage: %s <trace file>\n", argv[0]);
+      return 1;
+   }
+
+   FILE* file = fopen(argv[1], "rb");
+   if (NULL == file) {
+      printf_s("Cannot open %s\n", argv[1]);
+      return 1;
+   }
+
+   char magic[sizeof(TRACE_MAGIC) - 1];
+   if (sizeof(magic) != fread(magic, 1, sizeof(magic), file) || 0 != memcmp(magic, TRACE_MAGIC, sizeof(magic))) {
+      printf_s("%s is not a trace file\n", argv[1]);
+      fclose(file);
+      return 1;
+   }
+
+   //Records hold the low 32 bits of the cycle total; count the wraps.
+   static struct TraceRecord recs[4096];
+   uint64_t high = 0;
+   uint32_t last = 0;
+   size_t count;
+   while (0 != (count = fread(recs, sizeof(struct TraceRecord), sizeof(recs) / sizeof(recs[0]), file))) {
+      for (size_t k = 0; k < count; k++) {
+         const struct TraceRecord* r = &recs[k];
+         switch (r->kind) {
+         case TRACE_INS:
+            if (r->cycles < last) {
+               high += 1ull << 32;
+            }
+            last = r->cycles;
+            printf_s("%12llu  %04X  %02X  A=%02X X=%02X Y=%02X SP=%02X PS=%02X\n",
+               (unsigned long long)(high | r->cycles), r->addr, r->val, r->a, r->x, r->y, r->sp, r->ps);
+            break;
+         case TRACE_READ:
+            printf_s("%12s  R [%04X] = %02X\n", "", r->addr, r->val);
+            break;
+         case TRACE_WRITE:
+            printf_s("%12s  W [%04X] = %02X\n", "", r->addr, r->val);
+            break;
+         default:
+            printf_s("Bad record kind %u\n", r->kind);
+            fclose(file);
+            return 1;
+         }
+      }
+   }
+
+   fclose(file);
+   return 0;
+}